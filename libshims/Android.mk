@@ -3,12 +3,27 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
-    NV_VectorImpl.cpp
+    NV_ChunkedSortedVectorImpl.cpp \
+    NV_PublishedVectorImpl.cpp \
+    NV_SortedVectorHashIndex.cpp \
+    NV_SortedVectorSnapshot.cpp \
+    NV_VectorConfig.cpp \
+    NV_VectorDump.cpp \
+    NV_VectorImpl.cpp \
+    NV_VectorPolicy.cpp \
+    NV_VectorPool.cpp \
+    NV_VectorRealtime.cpp \
+    NV_VectorReclaimer.cpp \
+    NV_VectorSlack.cpp \
+    NV_VectorTelemetry.cpp \
+    NV_VectorTrace.cpp \
+    NV_VectorWorkers.cpp
 
 LOCAL_C_INCLUDES := \
     external/safe-iop/include
 
 LOCAL_SHARED_LIBRARIES := \
+    libcutils \
     liblog \
     libutils
 
@@ -18,3 +33,117 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE_CLASS := SHARED_LIBRARIES
 
 include $(BUILD_SHARED_LIBRARY)
+
+# Host build of the shim and the benchmarks, using the stand-ins under
+# host/ for SharedBuffer, safe_iop, liblog and libcutils' properties.
+# host/Makefile builds the same thing on a plain Linux box.
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    NV_ChunkedSortedVectorImpl.cpp \
+    NV_PublishedVectorImpl.cpp \
+    NV_SortedVectorHashIndex.cpp \
+    NV_SortedVectorSnapshot.cpp \
+    NV_VectorConfig.cpp \
+    NV_VectorDump.cpp \
+    NV_VectorImpl.cpp \
+    NV_VectorPolicy.cpp \
+    NV_VectorPool.cpp \
+    NV_VectorRealtime.cpp \
+    NV_VectorReclaimer.cpp \
+    NV_VectorSlack.cpp \
+    NV_VectorTelemetry.cpp \
+    NV_VectorTrace.cpp \
+    NV_VectorWorkers.cpp \
+    host/SharedBuffer.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/host/include
+
+LOCAL_LDLIBS := -ldl -lpthread
+
+LOCAL_MODULE := libshim_vectorimpl
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_SHARED_LIBRARY)
+
+vectorimpl_benchmark_src_files := \
+    benchmarks/Benchmark.cpp \
+    benchmarks/chunked_sorted_vector_benchmark.cpp \
+    benchmarks/published_vector_benchmark.cpp \
+    benchmarks/sort_benchmark.cpp \
+    benchmarks/sorted_vector_benchmark.cpp \
+    benchmarks/vector_benchmark.cpp
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(vectorimpl_benchmark_src_files)
+
+LOCAL_SHARED_LIBRARIES := \
+    libshim_vectorimpl \
+    liblog \
+    libutils
+
+LOCAL_MODULE := vectorimpl_benchmark
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(vectorimpl_benchmark_src_files)
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/host/include
+
+LOCAL_SHARED_LIBRARIES := \
+    libshim_vectorimpl
+
+LOCAL_LDLIBS := -lrt
+
+LOCAL_MODULE := vectorimpl_benchmark
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Checks sort(), radixSort() and editBatch() against std:: on the host:
+# run it with VECTORIMPL_WORKERS=1 and with more workers, so both the
+# serial and the parallel sort get checked.
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := benchmarks/sort_test.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/host/include
+
+LOCAL_SHARED_LIBRARIES := \
+    libshim_vectorimpl
+
+LOCAL_MODULE := vectorimpl_test
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Checks that published versions go away once, after their last reader.
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := benchmarks/published_vector_test.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/host/include
+
+LOCAL_SHARED_LIBRARIES := \
+    libshim_vectorimpl
+
+LOCAL_MODULE := vectorimpl_published_test
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ChunkedSortedVector"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <log/log.h>
+
+#include "NV_ChunkedSortedVectorImpl.h"
+#include "NV_VectorImpl.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+ChunkedSortedVectorImpl::ChunkedSortedVectorImpl(size_t itemSize, uint32_t flags)
+    :   mChunks(0), mNumChunks(0), mChunksCapacity(0), mValidStarts(0), mCount(0),
+        mFlags(flags), mItemSize(itemSize),
+        mChunkCapacity(CHUNK_BYTES / itemSize > MIN_CHUNK_ITEMS ?
+                CHUNK_BYTES / itemSize : size_t(MIN_CHUNK_ITEMS))
+{
+}
+
+ChunkedSortedVectorImpl::~ChunkedSortedVectorImpl()
+{
+    ALOGW_IF(mCount,
+        "[%p] subclasses of ChunkedSortedVectorImpl must call finish_vector()"
+        " in their destructor. Leaking %d bytes.",
+        this, (int)(mCount*mItemSize));
+    // We can't call _do_destroy() here because the vtable is already gone.
+    if (!mCount) {
+        free(mChunks);
+    }
+}
+
+void ChunkedSortedVectorImpl::finish_vector()
+{
+    clear();
+    free(mChunks);
+    mChunks = 0;
+    mChunksCapacity = 0;
+}
+
+void ChunkedSortedVectorImpl::clear()
+{
+    for (size_t c = 0 ; c < mNumChunks ; c++) {
+        _do_destroy(mChunks[c].items, mChunks[c].count);
+        free(mChunks[c].items);
+    }
+    mNumChunks = 0;
+    mValidStarts = 0;
+    mCount = 0;
+}
+
+const void* ChunkedSortedVectorImpl::itemLocation(size_t index) const
+{
+    ALOG_ASSERT(index<mCount,
+        "[%p] itemLocation: index=%d, count=%d",
+        this, (int)index, (int)mCount);
+
+    if (index >= mCount) {
+        return 0;
+    }
+    _start(mNumChunks - 1);
+    size_t l = 0;
+    size_t h = mNumChunks;
+    while (h - l > 1) {
+        const size_t mid = l + (h - l)/2;
+        if (mChunks[mid].start <= index) {
+            l = mid;
+        } else {
+            h = mid;
+        }
+    }
+    return _itemAt(mChunks[l], index - mChunks[l].start);
+}
+
+ssize_t ChunkedSortedVectorImpl::indexOf(const void* item) const
+{
+    if (!mCount) {
+        return NAME_NOT_FOUND;
+    }
+    const size_t c = _chunkOf(item);
+    size_t position;
+    if (_positionOf(mChunks[c], item, &position) < 0) {
+        return NAME_NOT_FOUND;
+    }
+    return _start(c) + position;
+}
+
+size_t ChunkedSortedVectorImpl::orderOf(const void* item) const
+{
+    if (!mCount) {
+        return 0;
+    }
+    const size_t c = _chunkOf(item);
+    size_t position;
+    _positionOf(mChunks[c], item, &position);
+    return _start(c) + position;
+}
+
+ssize_t ChunkedSortedVectorImpl::add(const void* item)
+{
+    if (!mCount) {
+        if (!mNumChunks && _insertChunk(0) != NO_ERROR) {
+            return NO_MEMORY;
+        }
+        return _insertAt(item, 0, 0);
+    }
+
+    // tables are often built from sorted data: try appending first
+    const size_t last = mNumChunks - 1;
+    char* const lastItem = _itemAt(mChunks[last], mChunks[last].count - 1);
+    const int c = do_compare(lastItem, item);
+    if (c < 0) {
+        return _insertAt(item, last, mChunks[last].count);
+    }
+    if (c == 0) {
+        _replace(lastItem, item);
+        return mCount - 1;
+    }
+
+    const size_t chunk = _chunkOf(item);
+    size_t position;
+    if (_positionOf(mChunks[chunk], item, &position) >= 0) {
+        _replace(_itemAt(mChunks[chunk], position), item);
+        return _start(chunk) + position;
+    }
+    return _insertAt(item, chunk, position);
+}
+
+ssize_t ChunkedSortedVectorImpl::merge(const VectorImpl& vector)
+{
+    const char* item = reinterpret_cast<const char*>(vector.arrayImpl());
+    const size_t s = vector.itemSize();
+    LOG_ALWAYS_FATAL_IF(s != mItemSize,
+        "merging vectors of different types (this=%p, vector=%p)", this, &vector);
+    for (size_t i = 0 ; i < vector.size() ; i++, item += s) {
+        const ssize_t err = add(item);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return NO_ERROR;
+}
+
+ssize_t ChunkedSortedVectorImpl::merge(const SortedVectorImpl& vector)
+{
+    // items past our last one take the append path of add()
+    return merge(static_cast<const VectorImpl&>(vector));
+}
+
+ssize_t ChunkedSortedVectorImpl::remove(const void* item)
+{
+    if (!mCount) {
+        return NAME_NOT_FOUND;
+    }
+    const size_t chunk = _chunkOf(item);
+    size_t position;
+    if (_positionOf(mChunks[chunk], item, &position) < 0) {
+        return NAME_NOT_FOUND;
+    }
+    const size_t index = _start(chunk) + position;
+    _removeAt(chunk, position);
+    return index;
+}
+
+// ----------------------------------------------------------------------------
+
+char* ChunkedSortedVectorImpl::_itemAt(const Chunk& chunk, size_t position) const
+{
+    return chunk.items + position*mItemSize;
+}
+
+size_t ChunkedSortedVectorImpl::_chunkOf(const void* item) const
+{
+    // the last chunk starting at or before the item, or the first one
+    size_t l = 0;
+    size_t h = mNumChunks;
+    while (l < h) {
+        const size_t mid = l + (h - l)/2;
+        if (do_compare(mChunks[mid].items, item) > 0) {
+            h = mid;
+        } else {
+            l = mid + 1;
+        }
+    }
+    return l ? l - 1 : 0;
+}
+
+ssize_t ChunkedSortedVectorImpl::_positionOf(const Chunk& chunk, const void* item,
+        size_t* position) const
+{
+    // binary search
+    ssize_t err = NAME_NOT_FOUND;
+    ssize_t l = 0;
+    ssize_t h = chunk.count-1;
+    ssize_t mid;
+    while (l <= h) {
+        mid = l + (h - l)/2;
+        const int c = do_compare(_itemAt(chunk, mid), item);
+        if (c == 0) {
+            err = l = mid;
+            break;
+        } else if (c < 0) {
+            l = mid + 1;
+        } else {
+            h = mid - 1;
+        }
+    }
+    *position = l;
+    return err;
+}
+
+size_t ChunkedSortedVectorImpl::_start(size_t chunk) const
+{
+    if (chunk >= mValidStarts) {
+        size_t c = mValidStarts;
+        size_t start = c ? mChunks[c-1].start + mChunks[c-1].count : 0;
+        for ( ; c <= chunk ; c++) {
+            mChunks[c].start = start;
+            start += mChunks[c].count;
+        }
+        mValidStarts = chunk + 1;
+    }
+    return mChunks[chunk].start;
+}
+
+void ChunkedSortedVectorImpl::_invalidateStarts(size_t chunk)
+{
+    if (mValidStarts > chunk) {
+        mValidStarts = chunk;
+    }
+}
+
+status_t ChunkedSortedVectorImpl::_insertChunk(size_t chunk)
+{
+    if (mNumChunks == mChunksCapacity) {
+        const size_t capacity = mChunksCapacity ? mChunksCapacity*2 : 4;
+        Chunk* chunks = static_cast<Chunk*>(realloc(mChunks, capacity*sizeof(Chunk)));
+        if (!chunks) {
+            return NO_MEMORY;
+        }
+        mChunks = chunks;
+        mChunksCapacity = capacity;
+    }
+    void* items;
+    if (posix_memalign(&items, CHUNK_ALIGN, mChunkCapacity*mItemSize)) {
+        return NO_MEMORY;
+    }
+    memmove(mChunks + chunk + 1, mChunks + chunk, (mNumChunks - chunk)*sizeof(Chunk));
+    mChunks[chunk].items = static_cast<char*>(items);
+    mChunks[chunk].count = 0;
+    mNumChunks++;
+    _invalidateStarts(chunk);
+    return NO_ERROR;
+}
+
+void ChunkedSortedVectorImpl::_removeChunk(size_t chunk)
+{
+    free(mChunks[chunk].items);
+    memmove(mChunks + chunk, mChunks + chunk + 1, (mNumChunks - chunk - 1)*sizeof(Chunk));
+    mNumChunks--;
+    _invalidateStarts(chunk);
+}
+
+ssize_t ChunkedSortedVectorImpl::_insertAt(const void* item, size_t chunk, size_t position)
+{
+    if (mChunks[chunk].count == mChunkCapacity) {
+        if (_insertChunk(chunk + 1) != NO_ERROR) {
+            return NO_MEMORY;
+        }
+        Chunk& full = mChunks[chunk];
+        if (chunk + 2 == mNumChunks && position == full.count) {
+            // appending: leave the full chunk alone, start the next one
+            chunk++;
+            position = 0;
+        } else {
+            // split in halves, the item goes in whichever owns position
+            Chunk& next = mChunks[chunk + 1];
+            const size_t half = full.count / 2;
+            do_move_backward(next.items, _itemAt(full, half), full.count - half);
+            next.count = full.count - half;
+            full.count = half;
+            if (position > half) {
+                chunk++;
+                position -= half;
+            }
+        }
+    }
+
+    Chunk& target = mChunks[chunk];
+    char* const where = _itemAt(target, position);
+    if (position < target.count) {
+        do_move_forward(where + mItemSize, where, target.count - position);
+    }
+    _do_copy(where, item, 1);
+    target.count++;
+    mCount++;
+    _invalidateStarts(chunk + 1);
+    return _start(chunk) + position;
+}
+
+void ChunkedSortedVectorImpl::_removeAt(size_t chunk, size_t position)
+{
+    Chunk& target = mChunks[chunk];
+    char* const where = _itemAt(target, position);
+    _do_destroy(where, 1);
+    if (position + 1 < target.count) {
+        do_move_backward(where, where + mItemSize, target.count - position - 1);
+    }
+    target.count--;
+    mCount--;
+    _invalidateStarts(chunk + 1);
+    if (!target.count) {
+        _removeChunk(chunk);
+    } else if (target.count < mChunkCapacity/4) {
+        _fold(chunk);
+    }
+}
+
+void ChunkedSortedVectorImpl::_fold(size_t chunk)
+{
+    // fold a nearly empty chunk into a neighbour if the result is no more
+    // than half full, so that the next insertion can't split it right away
+    size_t into;
+    if (chunk + 1 < mNumChunks &&
+            mChunks[chunk].count + mChunks[chunk + 1].count <= mChunkCapacity/2) {
+        into = chunk;
+        chunk++;
+    } else if (chunk > 0 &&
+            mChunks[chunk - 1].count + mChunks[chunk].count <= mChunkCapacity/2) {
+        into = chunk - 1;
+    } else {
+        return;
+    }
+    Chunk& dest = mChunks[into];
+    const Chunk& from = mChunks[chunk];
+    do_move_backward(_itemAt(dest, dest.count), from.items, from.count);
+    dest.count += from.count;
+    _invalidateStarts(into + 1);
+    _removeChunk(chunk);
+}
+
+void ChunkedSortedVectorImpl::_replace(char* at, const void* item)
+{
+    if (at != item) {
+        _do_destroy(at, 1);
+        _do_copy(at, item, 1);
+    }
+}
+
+void ChunkedSortedVectorImpl::_do_destroy(void* storage, size_t num) const
+{
+    if (!(mFlags & VectorImpl::HAS_TRIVIAL_DTOR)) {
+        do_destroy(storage, num);
+    }
+}
+
+void ChunkedSortedVectorImpl::_do_copy(void* dest, const void* from, size_t num) const
+{
+    if (!(mFlags & VectorImpl::HAS_TRIVIAL_COPY)) {
+        do_copy(dest, from, num);
+    } else {
+        memcpy(dest, from, num*mItemSize);
+    }
+}
+
+}; // namespace android
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_CHUNKED_SORTED_VECTOR_IMPL_H
+#define NV_CHUNKED_SORTED_VECTOR_IMPL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+class VectorImpl;
+class SortedVectorImpl;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * A sorted container with the semantics of SortedVectorImpl, for key sets
+ * too large for a single contiguous buffer.
+ *
+ * Items live in cache-line aligned chunks of about CHUNK_BYTES each,
+ * indexed by a flat directory, like the leaves of a one-level B+-tree.
+ * Lookups binary search the directory, then one chunk. add() and
+ * remove() only move items inside one chunk: a full chunk is split in
+ * halves and a nearly empty one is folded into a neighbour, so both cost
+ * O(log n + chunk size) instead of moving the whole tail. Appending past
+ * the last item fills chunks completely, so sorted input packs tightly.
+ *
+ * Indices are kept per chunk and brought up to date lazily: the first
+ * lookup after a change pays one pass over the directory entries after
+ * the changed chunk.
+ *
+ * Like VectorImpl, subclasses provide the item operations (flags are the
+ * VectorImpl::HAS_TRIVIAL_* ones) and must call finish_vector() in their
+ * destructor. Unlike it, storage isn't shared: the container can't be
+ * copied.
+ */
+class ChunkedSortedVectorImpl
+{
+public:
+    enum {
+        CHUNK_BYTES     = 1024,
+        MIN_CHUNK_ITEMS = 8,
+        CHUNK_ALIGN     = 64,
+    };
+
+                            ChunkedSortedVectorImpl(size_t itemSize, uint32_t flags);
+    virtual                 ~ChunkedSortedVectorImpl();
+
+    inline  size_t          size() const        { return mCount; }
+    inline  bool            isEmpty() const     { return mCount == 0; }
+    inline  size_t          itemSize() const    { return mItemSize; }
+
+    //! items per chunk
+    inline  size_t          chunkCapacity() const { return mChunkCapacity; }
+
+    //! the item at index, found in O(log n)
+            const void*     itemLocation(size_t index) const;
+
+    //! finds the index of an item
+            ssize_t         indexOf(const void* item) const;
+
+    //! finds where this item should be inserted
+            size_t          orderOf(const void* item) const;
+
+    //! add an item in the right place (or replaces it if there is one)
+            ssize_t         add(const void* item);
+
+    //! merges a vector into this one
+            ssize_t         merge(const VectorImpl& vector);
+            ssize_t         merge(const SortedVectorImpl& vector);
+
+    //! removes an item
+            ssize_t         remove(const void* item);
+
+            void            clear();
+
+protected:
+    virtual void            do_destroy(void* storage, size_t num) const = 0;
+    virtual void            do_copy(void* dest, const void* from, size_t num) const = 0;
+    virtual void            do_move_forward(void* dest, const void* from, size_t num) const = 0;
+    virtual void            do_move_backward(void* dest, const void* from, size_t num) const = 0;
+    virtual int             do_compare(const void* lhs, const void* rhs) const = 0;
+
+            void            finish_vector();
+
+private:
+    struct Chunk {
+        char*       items;
+        size_t      count;
+        size_t      start;      // index of items[0], valid below mValidStarts
+    };
+
+            // storage can't be shared, and copying a whole tree should
+            // be spelled out: no implementation
+                            ChunkedSortedVectorImpl(const ChunkedSortedVectorImpl&);
+    ChunkedSortedVectorImpl& operator = (const ChunkedSortedVectorImpl&);
+
+    inline  char*           _itemAt(const Chunk& chunk, size_t position) const;
+            size_t          _chunkOf(const void* item) const;
+            ssize_t         _positionOf(const Chunk& chunk, const void* item,
+                                        size_t* position) const;
+            size_t          _start(size_t chunk) const;
+            void            _invalidateStarts(size_t chunk);
+            status_t        _insertChunk(size_t chunk);
+            void            _removeChunk(size_t chunk);
+            ssize_t         _insertAt(const void* item, size_t chunk, size_t position);
+            void            _removeAt(size_t chunk, size_t position);
+            void            _fold(size_t chunk);
+            void            _replace(char* at, const void* item);
+
+    inline  void            _do_destroy(void* storage, size_t num) const;
+    inline  void            _do_copy(void* dest, const void* from, size_t num) const;
+
+            Chunk*          mChunks;
+            size_t          mNumChunks;
+            size_t          mChunksCapacity;
+    mutable size_t          mValidStarts;
+            size_t          mCount;
+    const   uint32_t        mFlags;
+    const   size_t          mItemSize;
+    const   size_t          mChunkCapacity;
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // NV_CHUNKED_SORTED_VECTOR_IMPL_H
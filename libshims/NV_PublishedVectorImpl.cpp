@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "PublishedVectorImpl"
+
+#include <log/log.h>
+#include <utils/SharedBuffer.h>
+
+#include "NV_PublishedVectorImpl.h"
+#include "NV_VectorImpl.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+/*
+ * A published version. While it is, its readers count their pins in
+ * mCurrent and refs stays 0. publish() hands the pins over by adding them
+ * to refs, and each reader that pinned it takes one away once done; the
+ * readers done before the handoff take refs below 0. Whichever of them
+ * brings refs back to 0 frees the version.
+ */
+struct PublishedVectorImpl::Version {
+    std::atomic<int32_t>    refs;
+    void*                   storage;
+    size_t                  count;
+    uint64_t                generation;
+};
+
+namespace {
+
+/*
+ * mCurrent packs the address of the published Version with the number of
+ * readers pinning it, in bits user space addresses leave clear: the upper
+ * half on 32-bit, and bits 48 to 55 on 64-bit, below the top byte arm64
+ * may tag heap pointers with. Only readers in the middle of read() pin,
+ * so there are never more than there are threads.
+ */
+const int kPinShift = sizeof(void*) == 8 ? 48 : 32;
+const uint64_t kMaxPins = sizeof(void*) == 8 ? 0xff : 0xffffffff;
+const uint64_t kOnePin = uint64_t(1) << kPinShift;
+const uint64_t kPinMask = kMaxPins << kPinShift;
+
+inline uint64_t addressOf(const void* version) {
+    return reinterpret_cast<uintptr_t>(version);
+}
+
+inline uint64_t pinsOf(uint64_t current) {
+    return (current & kPinMask) >> kPinShift;
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+PublishedVectorImpl::PublishedVectorImpl(VectorImpl& vector)
+    :   mVector(vector), mCurrent(0), mGeneration(0)
+{
+}
+
+PublishedVectorImpl::~PublishedVectorImpl()
+{
+    const uint64_t current = mCurrent.exchange(0, std::memory_order_acq_rel);
+    Version* version = reinterpret_cast<Version*>(uintptr_t(current & ~kPinMask));
+    LOG_ALWAYS_FATAL_IF(pinsOf(current),
+            "PublishedVectorImpl %p destroyed during a read()", this);
+    if (version) {
+        _release(version, 0);
+    }
+}
+
+void PublishedVectorImpl::publish()
+{
+    Version* version = new Version;
+    version->refs.store(0, std::memory_order_relaxed);
+    version->storage = const_cast<void*>(mVector.arrayImpl());
+    version->count = mVector.size();
+    if (version->storage) {
+        // frozen from now on: the writer's next edit copies it
+        SharedBuffer::bufferFromData(version->storage)->acquire();
+    }
+    version->generation = mGeneration.load(std::memory_order_relaxed) + 1;
+    LOG_ALWAYS_FATAL_IF(addressOf(version) & kPinMask,
+            "version %p overlaps the pin count", version);
+
+    const uint64_t previous = mCurrent.exchange(addressOf(version), std::memory_order_acq_rel);
+    mGeneration.store(version->generation, std::memory_order_release);
+    Version* old = reinterpret_cast<Version*>(uintptr_t(previous & ~kPinMask));
+    if (old) {
+        // the readers pinning it now hold references instead
+        _release(old, -int32_t(pinsOf(previous)));
+    }
+}
+
+void PublishedVectorImpl::read(VectorImpl& snapshot) const
+{
+    _read(snapshot);
+}
+
+bool PublishedVectorImpl::refresh(VectorImpl& snapshot, uint64_t* generation) const
+{
+    if (mGeneration.load(std::memory_order_acquire) == *generation) {
+        return false;
+    }
+    *generation = _read(snapshot);
+    return true;
+}
+
+PublishedVectorImpl::Version* PublishedVectorImpl::_pin() const
+{
+    const uint64_t current = mCurrent.fetch_add(kOnePin, std::memory_order_acquire);
+    LOG_ALWAYS_FATAL_IF(pinsOf(current) >= kMaxPins - 1,
+            "more than %llu readers at once", (unsigned long long)kMaxPins - 1);
+    return reinterpret_cast<Version*>(uintptr_t(current & ~kPinMask));
+}
+
+void PublishedVectorImpl::_unpin(Version* version) const
+{
+    uint64_t current = mCurrent.load(std::memory_order_relaxed);
+    while ((current & ~kPinMask) == addressOf(version)) {
+        if (mCurrent.compare_exchange_weak(current, current - kOnePin,
+                std::memory_order_release, std::memory_order_relaxed)) {
+            return;
+        }
+    }
+    // publish() turned the pin into a reference; an empty publisher has
+    // nothing to let go of
+    if (version) {
+        _release(version, 1);
+    }
+}
+
+void PublishedVectorImpl::_release(Version* version, int32_t refs) const
+{
+    if (version->refs.fetch_sub(refs, std::memory_order_acq_rel) != refs) {
+        return;
+    }
+    if (version->storage) {
+        // the vector's type destroys the items, if nobody else has them
+        mVector._release_storage(version->storage, version->count);
+    }
+    delete version;
+}
+
+uint64_t PublishedVectorImpl::_read(VectorImpl& snapshot) const
+{
+    LOG_ALWAYS_FATAL_IF(snapshot.itemSize() != mVector.itemSize(),
+        "Vector<> have different types (vector=%p, snapshot=%p)", &mVector, &snapshot);
+    Version* version = _pin();
+    void* storage = 0;
+    size_t count = 0;
+    uint64_t generation = 0;
+    if (version) {
+        storage = version->storage;
+        count = version->count;
+        generation = version->generation;
+        if (storage) {
+            SharedBuffer::bufferFromData(storage)->acquire();
+        }
+    }
+    _unpin(version);
+
+    snapshot.finish_vector();
+    snapshot.mStorage = storage;
+    snapshot.mCount = count;
+    return generation;
+}
+
+}; // namespace android
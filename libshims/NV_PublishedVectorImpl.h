@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_PUBLISHED_VECTOR_IMPL_H
+#define NV_PUBLISHED_VECTOR_IMPL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+
+namespace android {
+
+class VectorImpl;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Versions of a vector published for other threads to read without a lock,
+ * RCU style.
+ *
+ * A single writer edits the vector as usual and calls publish() to make its
+ * current contents the version the readers get. publish() doesn't copy: the
+ * version shares the storage, which is immutable from then on, and the next
+ * edit of the vector copies it like it would any shared storage. The
+ * version is swapped in with one atomic exchange.
+ *
+ * read() makes a vector of the same type share the storage of the current
+ * version. It's a snapshot: it holds the storage alive, and doesn't change
+ * when newer versions are published. Old versions go away with their last
+ * snapshot. Taking one never waits for the writer: it pins the version
+ * with a fetch_add on a word that packs the version with a count of pins,
+ * and unpins it with a CAS, retried only while other readers pin at the
+ * same time, or with a decrement of the version's count once the writer
+ * has moved on. refresh() skips all of it while the snapshot is current,
+ * for readers that keep theirs around: checking costs them a single load,
+ * so they don't even share a written cache line.
+ *
+ * vector must outlive the publisher, and the publisher the calls to read()
+ * and refresh(); the snapshots may outlive both.
+ */
+class PublishedVectorImpl
+{
+public:
+    explicit                PublishedVectorImpl(VectorImpl& vector);
+                            ~PublishedVectorImpl();
+
+    //! makes the current contents of the vector the published version
+            void            publish();
+
+    /*! makes snapshot, a vector of the same type, share the published
+     *  version, or empties it if none was published yet */
+            void            read(VectorImpl& snapshot) const;
+
+    /*! read(), unless *generation says snapshot has the published version
+     *  already: returns true if it changed. Start with *generation = 0 */
+            bool            refresh(VectorImpl& snapshot, uint64_t* generation) const;
+
+    //! of the published version, 0 before the first publish()
+    inline  uint64_t        generation() const {
+        return mGeneration.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Version;
+
+                            PublishedVectorImpl(const PublishedVectorImpl&);
+    PublishedVectorImpl&    operator = (const PublishedVectorImpl&);
+
+            Version*        _pin() const;
+            void            _unpin(Version* version) const;
+            void            _release(Version* version, int32_t refs) const;
+            uint64_t        _read(VectorImpl& snapshot) const;
+
+            VectorImpl&                     mVector;
+    mutable std::atomic<uint64_t>           mCurrent;       // Version and pins
+            std::atomic<uint64_t>           mGeneration;
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // NV_PUBLISHED_VECTOR_IMPL_H
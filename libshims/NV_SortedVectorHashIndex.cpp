@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SortedVectorHashIndex"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <log/log.h>
+
+#include "NV_SortedVectorHashIndex.h"
+#include "NV_VectorImpl.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+namespace {
+
+const size_t kMinSlots = 16;
+
+// spreads weak hashes (small integers, aligned pointers) over the low
+// bits the table is indexed with
+inline uint32_t mix(uint32_t hash) {
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+SortedVectorHashIndex::SortedVectorHashIndex(SortedVectorImpl& vector, hash_t hash)
+    :   mVector(vector), mHash(hash), mSlots(0), mMask(0), mSyncedSize(0), mStale(true)
+{
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+SortedVectorHashIndex::~SortedVectorHashIndex()
+{
+    free(mSlots);
+}
+
+ssize_t SortedVectorHashIndex::indexOf(const void* item) const
+{
+    if (!_sync()) {
+        return mVector.indexOf(item);
+    }
+    const uint32_t hash = mix(mHash(item));
+    mStats.lookups++;
+    for (size_t i = hash & mMask ; mSlots[i].position ; i = (i + 1) & mMask) {
+        mStats.probes++;
+        if (mSlots[i].hash == hash && _compare(mSlots[i].position - 1, item) == 0) {
+            return mSlots[i].position - 1;
+        }
+    }
+    return NAME_NOT_FOUND;
+}
+
+ssize_t SortedVectorHashIndex::add(const void* item)
+{
+    const size_t before = mVector.size();
+    const ssize_t index = mVector.add(item);
+    if (index < 0 || mVector.size() == before) {
+        // failed, or replaced an item with the same key in the same place
+        return index;
+    }
+    if (mStale || before != mSyncedSize || (before + 1)*2 > mMask + 1) {
+        // out of step already, or due to grow: rebuild on next use
+        mStale = true;
+        return index;
+    }
+    if (size_t(index) != before) {
+        _renumber(index, 1);
+    }
+    _insert(mix(mHash(item)), index);
+    mSyncedSize = before + 1;
+    return index;
+}
+
+ssize_t SortedVectorHashIndex::remove(const void* item)
+{
+    const size_t before = mVector.size();
+    const ssize_t index = mVector.remove(item);
+    if (index < 0) {
+        return index;
+    }
+    if (mStale || before != mSyncedSize) {
+        mStale = true;
+        return index;
+    }
+    _erase(mix(mHash(item)), index);
+    if (size_t(index) != before - 1) {
+        _renumber(index + 1, -1);
+    }
+    mSyncedSize = before - 1;
+    return index;
+}
+
+ssize_t SortedVectorHashIndex::merge(const VectorImpl& vector)
+{
+    mStale = true;
+    return mVector.merge(vector);
+}
+
+ssize_t SortedVectorHashIndex::merge(const SortedVectorImpl& vector)
+{
+    mStale = true;
+    return mVector.merge(vector);
+}
+
+void SortedVectorHashIndex::invalidate()
+{
+    mStale = true;
+}
+
+void SortedVectorHashIndex::getStats(Stats* stats) const
+{
+    *stats = mStats;
+    stats->items = mStale ? 0 : mSyncedSize;
+    stats->slots = mSlots ? mMask + 1 : 0;
+    stats->bytes = sizeof(*this) + stats->slots*sizeof(Slot);
+}
+
+void SortedVectorHashIndex::dumpStats(int fd, const char* name) const
+{
+    Stats stats;
+    getStats(&stats);
+    dprintf(fd, "%s: %zu items, %zu slots, %zu bytes (%.1f per item), "
+            "%llu lookups, %.2f probes per lookup, %llu rebuilds, %llu renumbers\n",
+            name, stats.items, stats.slots, stats.bytes,
+            stats.items ? double(stats.bytes) / stats.items : 0.0,
+            (unsigned long long)stats.lookups,
+            stats.lookups ? double(stats.probes) / stats.lookups : 0.0,
+            (unsigned long long)stats.rebuilds, (unsigned long long)stats.renumbers);
+}
+
+// ----------------------------------------------------------------------------
+
+bool SortedVectorHashIndex::_sync() const
+{
+    const size_t count = mVector.size();
+    if (mStale || count != mSyncedSize) {
+        return _rebuild(count);
+    }
+    return true;
+}
+
+bool SortedVectorHashIndex::_rebuild(size_t count) const
+{
+    size_t slots = kMinSlots;
+    while (slots < count*2) {
+        slots <<= 1;
+    }
+    if (slots != mMask + 1 || !mSlots) {
+        Slot* table = static_cast<Slot*>(malloc(slots*sizeof(Slot)));
+        if (!table) {
+            ALOGW("[%p] can't allocate %zu slots, falling back to indexOf()", this, slots);
+            return false;
+        }
+        free(mSlots);
+        mSlots = table;
+        mMask = slots - 1;
+    }
+    memset(mSlots, 0, slots*sizeof(Slot));
+
+    const char* item = reinterpret_cast<const char*>(mVector.arrayImpl());
+    const size_t s = mVector.itemSize();
+    for (size_t i = 0 ; i < count ; i++, item += s) {
+        _insert(mix(mHash(item)), i);
+    }
+    mSyncedSize = count;
+    mStale = false;
+    mStats.rebuilds++;
+    return true;
+}
+
+void SortedVectorHashIndex::_insert(uint32_t hash, size_t position) const
+{
+    size_t i = hash & mMask;
+    while (mSlots[i].position) {
+        i = (i + 1) & mMask;
+    }
+    mSlots[i].hash = hash;
+    mSlots[i].position = position + 1;
+}
+
+void SortedVectorHashIndex::_erase(uint32_t hash, size_t position)
+{
+    size_t i = hash & mMask;
+    while (mSlots[i].position != position + 1) {
+        LOG_ALWAYS_FATAL_IF(!mSlots[i].position,
+            "[%p] position %zu missing from the index", this, position);
+        i = (i + 1) & mMask;
+    }
+
+    // backward shift deletion: pull later entries of the cluster into the
+    // hole when that doesn't move them before their home slot
+    for (;;) {
+        mSlots[i].position = 0;
+        size_t j = i;
+        for (;;) {
+            j = (j + 1) & mMask;
+            if (!mSlots[j].position) {
+                return;
+            }
+            const size_t home = mSlots[j].hash & mMask;
+            if (((j - home) & mMask) >= ((j - i) & mMask)) {
+                break;
+            }
+        }
+        mSlots[i] = mSlots[j];
+        i = j;
+    }
+}
+
+void SortedVectorHashIndex::_renumber(size_t from, ssize_t delta)
+{
+    // stored positions are off by one, so from + 1 and up move
+    const uint32_t first = from + 1;
+    for (size_t i = 0 ; i <= mMask ; i++) {
+        if (mSlots[i].position >= first) {
+            mSlots[i].position += delta;
+        }
+    }
+    mStats.renumbers++;
+}
+
+int SortedVectorHashIndex::_compare(size_t position, const void* item) const
+{
+    const char* array = reinterpret_cast<const char*>(mVector.arrayImpl());
+    return mVector.do_compare(array + position*mVector.itemSize(), item);
+}
+
+}; // namespace android
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_SORTED_VECTOR_HASH_INDEX_H
+#define NV_SORTED_VECTOR_HASH_INDEX_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+class VectorImpl;
+class SortedVectorImpl;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Opt-in hash index over a SortedVectorImpl, mapping key hashes to
+ * positions so that indexOf() is O(1) instead of O(log n) virtual
+ * compares. The vector itself is untouched: ordered iteration, and
+ * every other reader, keep working on it as before.
+ *
+ * hash must hash the part of an item do_compare() looks at, so that
+ * items comparing equal hash equal. Candidates are still confirmed with
+ * do_compare().
+ *
+ * Mutations must go through the index to keep it in step:
+ *  - add() and remove() update it incrementally. Appends and replacements
+ *    are O(1); an insertion or removal in the middle also renumbers the
+ *    positions after it, one pass over the table like the memmove the
+ *    vector does anyway.
+ *  - merge() and anything done to the vector directly (call invalidate()
+ *    afterwards) leave it stale, and the next lookup rebuilds it in O(n).
+ *    A change of size behind its back is caught the same way.
+ *
+ * The table is open addressed, at most half full, 8 bytes per slot.
+ * getStats() reports its footprint so that it can be enabled only on
+ * the tables where it pays for itself.
+ */
+class SortedVectorHashIndex
+{
+public:
+    typedef uint32_t (*hash_t)(const void* item);
+
+                            SortedVectorHashIndex(SortedVectorImpl& vector, hash_t hash);
+                            ~SortedVectorHashIndex();
+
+    //! finds the index of an item in the vector
+            ssize_t         indexOf(const void* item) const;
+
+    //! SortedVectorImpl::add(), keeping the index up to date
+            ssize_t         add(const void* item);
+
+    //! SortedVectorImpl::remove(), keeping the index up to date
+            ssize_t         remove(const void* item);
+
+    //! SortedVectorImpl::merge(), the index is rebuilt on next use
+            ssize_t         merge(const VectorImpl& vector);
+            ssize_t         merge(const SortedVectorImpl& vector);
+
+    //! the vector was edited directly: rebuild on next use
+            void            invalidate();
+
+    struct Stats {
+        size_t      items;          // items indexed
+        size_t      slots;          // table slots
+        size_t      bytes;          // memory used by the table
+        uint64_t    lookups;        // indexOf() calls
+        uint64_t    probes;         // slots they visited
+        uint64_t    rebuilds;       // full rebuilds
+        uint64_t    renumbers;      // passes renumbering positions
+    };
+            void            getStats(Stats* stats) const;
+            void            dumpStats(int fd, const char* name) const;
+
+private:
+    struct Slot {
+        uint32_t    hash;
+        uint32_t    position;       // index in the vector + 1, 0 if empty
+    };
+
+                            SortedVectorHashIndex(const SortedVectorHashIndex&);
+    SortedVectorHashIndex&  operator = (const SortedVectorHashIndex&);
+
+            bool            _sync() const;
+            bool            _rebuild(size_t count) const;
+            void            _insert(uint32_t hash, size_t position) const;
+            void            _erase(uint32_t hash, size_t position);
+            void            _renumber(size_t from, ssize_t delta);
+            int             _compare(size_t position, const void* item) const;
+
+            SortedVectorImpl&   mVector;
+    const   hash_t              mHash;
+    mutable Slot*               mSlots;
+    mutable size_t              mMask;          // slots - 1
+    mutable size_t              mSyncedSize;    // vector size the table matches
+    mutable bool                mStale;
+    mutable Stats               mStats;
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // NV_SORTED_VECTOR_HASH_INDEX_H
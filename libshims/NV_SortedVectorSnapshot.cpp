@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SortedVectorSnapshot"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <new>
+
+#include <log/log.h>
+#include <safe_iop.h>
+#include <utils/SharedBuffer.h>
+
+#include "NV_SortedVectorSnapshot.h"
+#include "NV_VectorImpl.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+namespace {
+
+const uint32_t kMagic = 0x504e5356;         // "VSNP"
+const uint32_t kByteOrder = 0x01020304;
+
+/*
+ * Start of the file. The items follow at dataOffset, a multiple of the
+ * page size of the writer, and the SharedBuffer header goes right before
+ * them, in the padding after this one.
+ */
+struct FileHeader {
+    uint32_t    magic;
+    uint32_t    byteOrder;      // kByteOrder, as the writer stored it
+    uint32_t    version;
+    uint32_t    type;
+    uint64_t    itemSize;
+    uint64_t    count;
+    uint64_t    dataOffset;
+};
+
+// the layout of SharedBuffer, see NV_VectorPool.cpp
+struct SharedBufferHeader {
+    int32_t     refs;
+    size_t      size;
+    uint32_t    reserved[2];
+};
+
+static_assert(sizeof(SharedBufferHeader) == sizeof(SharedBuffer),
+        "SharedBuffer layout changed");
+
+/*
+ * Mappings closed while vectors still shared them. They're unmapped by a
+ * later open() or close() of any snapshot, once the vectors let go.
+ */
+struct Orphan {
+    void*       base;
+    size_t      length;
+    const SharedBuffer* buffer;
+    Orphan*     next;
+};
+
+Orphan* gOrphans = 0;
+pthread_mutex_t gOrphansLock = PTHREAD_MUTEX_INITIALIZER;
+
+void reapOrphans()
+{
+    pthread_mutex_lock(&gOrphansLock);
+    for (Orphan** p = &gOrphans ; *p ; ) {
+        Orphan* orphan = *p;
+        if (orphan->buffer->onlyOwner()) {
+            munmap(orphan->base, orphan->length);
+            *p = orphan->next;
+            delete orphan;
+        } else {
+            p = &orphan->next;
+        }
+    }
+    pthread_mutex_unlock(&gOrphansLock);
+}
+
+inline uintptr_t pageSize() {
+    return uintptr_t(sysconf(_SC_PAGESIZE));
+}
+
+status_t writeFully(int fd, const void* data, size_t length, off_t offset)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (length) {
+        const ssize_t n = pwrite(fd, p, length, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        p += n;
+        length -= size_t(n);
+        offset += n;
+    }
+    return NO_ERROR;
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+SortedVectorSnapshot::SortedVectorSnapshot()
+    :   mBase(0), mLength(0), mStorage(0), mCount(0), mItemSize(0)
+{
+}
+
+SortedVectorSnapshot::~SortedVectorSnapshot()
+{
+    close();
+}
+
+status_t SortedVectorSnapshot::write(const SortedVectorImpl& vector, const char* path,
+        uint32_t type)
+{
+    if (!(vector.mFlags & VectorImpl::HAS_TRIVIAL_COPY)) {
+        return BAD_TYPE;
+    }
+    char temp[PATH_MAX];
+    if (snprintf(temp, sizeof(temp), "%s.tmp", path) >= int(sizeof(temp))) {
+        return BAD_VALUE;
+    }
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kMagic;
+    header.byteOrder = kByteOrder;
+    header.version = VERSION;
+    header.type = type;
+    header.itemSize = vector.mItemSize;
+    header.count = vector.mCount;
+    header.dataOffset = pageSize();
+
+    const int fd = ::open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        const status_t err = -errno;
+        ALOGW("can't create %s: %s", temp, strerror(errno));
+        return err;
+    }
+    // the padding up to the items is a hole
+    status_t err = writeFully(fd, &header, sizeof(header), 0);
+    if (!err && ftruncate(fd, off_t(header.dataOffset))) {
+        err = -errno;
+    }
+    if (!err) {
+        err = writeFully(fd, vector.arrayImpl(), vector.mCount * vector.mItemSize,
+                off_t(header.dataOffset));
+    }
+    // on disk before it replaces the old one
+    if (!err && fsync(fd)) {
+        err = -errno;
+    }
+    if (::close(fd) && !err) {
+        err = -errno;
+    }
+    if (!err && rename(temp, path)) {
+        err = -errno;
+    }
+    if (err) {
+        ALOGW("can't write snapshot %s: %s", path, strerror(-err));
+        unlink(temp);
+    }
+    return err;
+}
+
+status_t SortedVectorSnapshot::open(const char* path, uint32_t type)
+{
+    close();
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    struct stat st;
+    FileHeader header;
+    if (fstat(fd, &st) || pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))) {
+        ::close(fd);
+        return BAD_VALUE;
+    }
+
+    size_t bytes = 0;
+    size_t length = 0;
+    if (header.magic != kMagic || header.byteOrder != kByteOrder) {
+        ALOGW("%s isn't a snapshot, or not from this byte order", path);
+    } else if (header.version != VERSION || header.type != type) {
+        ALOGW("%s is version %u of type %#x, wanted version %u of type %#x", path,
+                header.version, header.type, VERSION, type);
+    } else if (!header.itemSize || header.dataOffset % sizeof(uint64_t) ||
+            header.dataOffset < sizeof(FileHeader) + sizeof(SharedBuffer) ||
+            header.itemSize > SIZE_MAX || header.count > SIZE_MAX ||
+            header.dataOffset > SIZE_MAX ||
+            !safe_mul(&bytes, size_t(header.count), size_t(header.itemSize)) ||
+            !safe_add(&length, bytes, size_t(header.dataOffset)) ||
+            uint64_t(st.st_size) != length) {
+        ALOGW("%s is corrupt or truncated", path);
+    } else {
+        // writable for the header, which is the only page made private
+        mBase = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (mBase == MAP_FAILED) {
+            mBase = 0;
+            const status_t err = -errno;
+            ALOGW("can't map %s: %s", path, strerror(errno));
+            ::close(fd);
+            return err;
+        }
+    }
+    ::close(fd);
+    if (!mBase) {
+        return BAD_VALUE;
+    }
+
+    mLength = length;
+    mStorage = static_cast<uint8_t*>(mBase) + header.dataOffset;
+    mCount = size_t(header.count);
+    mItemSize = size_t(header.itemSize);
+    SharedBufferHeader* sb = reinterpret_cast<SharedBufferHeader*>(
+            SharedBuffer::bufferFromData(mStorage));
+    sb->refs = 1;
+    sb->size = bytes;
+    sb->reserved[0] = sb->reserved[1] = 0;
+
+    const uintptr_t page = pageSize();
+    const uintptr_t start = (reinterpret_cast<uintptr_t>(mStorage) + page - 1) & ~(page - 1);
+    const uintptr_t end = reinterpret_cast<uintptr_t>(mBase) + length;
+    if (start < end) {
+        mprotect(reinterpret_cast<void*>(start), end - start, PROT_READ);
+    }
+    return NO_ERROR;
+}
+
+status_t SortedVectorSnapshot::attach(SortedVectorImpl& vector) const
+{
+    if (!mBase) {
+        return NO_INIT;
+    }
+    if (vector.mItemSize != mItemSize || !(vector.mFlags & VectorImpl::HAS_TRIVIAL_COPY)) {
+        return BAD_TYPE;
+    }
+    if (!vector.isEmpty()) {
+        return INVALID_OPERATION;
+    }
+    if (mCount) {
+        // drops the capacity it may still have
+        vector.finish_vector();
+        SharedBuffer::bufferFromData(mStorage)->acquire();
+        vector.mStorage = mStorage;
+        vector.mCount = mCount;
+    }
+    return NO_ERROR;
+}
+
+void SortedVectorSnapshot::close()
+{
+    if (mBase) {
+        // a vector can only get the storage from the snapshot or another
+        // vector, so once it's ours alone it stays that way
+        const SharedBuffer* sb = SharedBuffer::bufferFromData(mStorage);
+        Orphan* orphan = 0;
+        if (sb->onlyOwner()) {
+            munmap(mBase, mLength);
+        } else if ((orphan = new (std::nothrow) Orphan) != 0) {
+            orphan->base = mBase;
+            orphan->length = mLength;
+            orphan->buffer = sb;
+            pthread_mutex_lock(&gOrphansLock);
+            orphan->next = gOrphans;
+            gOrphans = orphan;
+            pthread_mutex_unlock(&gOrphansLock);
+        } else {
+            ALOGW("snapshot of %zu items still in use, leaving it mapped", mCount);
+        }
+        mBase = 0;
+        mLength = 0;
+        mStorage = 0;
+        mCount = 0;
+        mItemSize = 0;
+    }
+    reapOrphans();
+}
+
+}; // namespace android
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_SORTED_VECTOR_SNAPSHOT_H
+#define NV_SORTED_VECTOR_SNAPSHOT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+class SortedVectorImpl;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Flat file image of a SortedVectorImpl of HAS_TRIVIAL_COPY items, for the
+ * big tables a service would otherwise rebuild with add() or merge() every
+ * time it starts.
+ *
+ * write() saves the items as they are in memory, after a versioned header
+ * and page aligned, and replaces the file atomically. open() maps the file
+ * privately and lays a SharedBuffer header right before the items, so
+ * attach() can hand that storage to any number of vectors: indexOf(),
+ * orderOf() and every other read work on the page cache, which is shared
+ * with the other processes mapping the file. Only the page of the header
+ * is ever private. The snapshot holds a reference on the storage of its
+ * own, so the first edit of a vector copies it into a SharedBuffer like it
+ * would for any shared storage; the pages of the items are mapped read-only
+ * to catch anything writing them in place.
+ *
+ * The file holds the raw bytes of the items: they must not point anywhere,
+ * and a file is only opened by a build with the same item layout. type is
+ * a tag of the caller's choosing for the kind of table, checked by open()
+ * along with the version, the item size and the byte order. The order of
+ * the items is trusted: write() took them from a sorted vector.
+ *
+ * The mapping is given back by close() or the destructor, or if a vector
+ * still shares it, by the first open() or close() after the last one let go.
+ */
+class SortedVectorSnapshot
+{
+public:
+    enum {
+        VERSION = 1
+    };
+
+                            SortedVectorSnapshot();
+                            ~SortedVectorSnapshot();
+
+    /*! saves the items of vector to path, BAD_TYPE for items that aren't
+     *  HAS_TRIVIAL_COPY */
+    static  status_t        write(const SortedVectorImpl& vector, const char* path,
+                                  uint32_t type);
+
+    /*! maps path, BAD_VALUE if it's not a snapshot of this version and type,
+     *  or is truncated */
+            status_t        open(const char* path, uint32_t type);
+
+    /*! makes the empty vector a read-only view of the items, BAD_TYPE if
+     *  they aren't the same size or vector's aren't HAS_TRIVIAL_COPY */
+            status_t        attach(SortedVectorImpl& vector) const;
+
+    //! unmaps the file, see above
+            void            close();
+
+    inline  bool            isOpen() const      { return mBase != 0; }
+    inline  size_t          size() const        { return mCount; }
+    inline  size_t          itemSize() const    { return mItemSize; }
+
+private:
+                            SortedVectorSnapshot(const SortedVectorSnapshot&);
+    SortedVectorSnapshot&   operator = (const SortedVectorSnapshot&);
+
+            void*           mBase;          // the whole file
+            size_t          mLength;
+            void*           mStorage;       // data of the SharedBuffer
+            size_t          mCount;
+            size_t          mItemSize;
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // NV_SORTED_VECTOR_SNAPSHOT_H
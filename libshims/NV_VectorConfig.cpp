@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VectorConfig"
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <cutils/properties.h>
+#include <log/log.h>
+
+#include "NV_VectorConfig.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+static const char kEnvPrefix[] = "VECTORIMPL_";
+static const char kPropertyPrefix[] = "vectorimpl.";
+
+// the environment wins over the property, NULL if neither is set
+static const char* configValue(const char* name, char* buffer)
+{
+    const char* value = getenv(name);
+    if (value && *value) {
+        return value;
+    }
+
+    char key[PROPERTY_KEY_MAX];
+    if (strncmp(name, kEnvPrefix, sizeof(kEnvPrefix) - 1) ||
+            strlen(name) - (sizeof(kEnvPrefix) - 1) + (sizeof(kPropertyPrefix) - 1) >= sizeof(key)) {
+        return NULL;
+    }
+    strcpy(key, kPropertyPrefix);
+    char* p = key + sizeof(kPropertyPrefix) - 1;
+    for (const char* n = name + sizeof(kEnvPrefix) - 1 ; *n ; n++) {
+        *p++ = (*n >= 'A' && *n <= 'Z') ? *n - 'A' + 'a' : *n;
+    }
+    *p = '\0';
+    if (property_get(key, buffer, "") > 0) {
+        return buffer;
+    }
+    return NULL;
+}
+
+bool vectorConfigBool(const char* name, bool defaultValue)
+{
+    char buffer[PROPERTY_VALUE_MAX];
+    const char* value = configValue(name, buffer);
+    if (!value) {
+        return defaultValue;
+    }
+    if (!strcmp(value, "1") || !strcasecmp(value, "y") || !strcasecmp(value, "yes") ||
+            !strcasecmp(value, "true") || !strcasecmp(value, "on")) {
+        return true;
+    }
+    if (!strcmp(value, "0") || !strcasecmp(value, "n") || !strcasecmp(value, "no") ||
+            !strcasecmp(value, "false") || !strcasecmp(value, "off")) {
+        return false;
+    }
+    ALOGW("ignoring %s=%s, not a boolean", name, value);
+    return defaultValue;
+}
+
+size_t vectorConfigSize(const char* name, size_t defaultValue)
+{
+    char buffer[PROPERTY_VALUE_MAX];
+    const char* value = configValue(name, buffer);
+    if (!value) {
+        return defaultValue;
+    }
+    char* end = 0;
+    unsigned long long result = strtoull(value, &end, 0);
+    switch (*end) {
+        case 'g': case 'G': result <<= 10; // fall through
+        case 'm': case 'M': result <<= 10; // fall through
+        case 'k': case 'K': result <<= 10; end++; break;
+        default: break;
+    }
+    if (end == value || *end != '\0' || result > SIZE_MAX) {
+        ALOGW("ignoring %s=%s, not a size", name, value);
+        return defaultValue;
+    }
+    return size_t(result);
+}
+
+const char* vectorConfigString(const char* name, const char* defaultValue,
+        char* buffer, size_t size)
+{
+    char property[PROPERTY_VALUE_MAX];
+    const char* value = configValue(name, property);
+    if (!value) {
+        value = defaultValue;
+    }
+    strncpy(buffer, value, size - 1);
+    buffer[size - 1] = '\0';
+    return buffer;
+}
+
+bool vectorShimResolves(const char* feature, const char* const* symbols, size_t count)
+{
+    Dl_info shim;
+    if (!dladdr(reinterpret_cast<void*>(&vectorShimResolves), &shim)) {
+        return false;
+    }
+    for (size_t i = 0 ; i < count ; i++) {
+        void* resolved = dlsym(RTLD_DEFAULT, symbols[i]);
+        Dl_info info;
+        if (!resolved || !dladdr(resolved, &info) || info.dli_fbase != shim.dli_fbase) {
+            ALOGW("%s isn't the shim's (%s), %s disabled", symbols[i],
+                    resolved && info.dli_fname ? info.dli_fname : "not found", feature);
+            return false;
+        }
+    }
+    return true;
+}
+
+}; // namespace android
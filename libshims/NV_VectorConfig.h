@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTOR_CONFIG_H
+#define NV_VECTOR_CONFIG_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Tunables of the VectorImpl shim. Every optional feature is off unless
+ * switched on through the environment of the shimmed process, e.g. with
+ * an "export VECTORIMPL_POOL 1" next to LD_SHIM_LIBS in init.mojo.rc, or
+ * a "setenv" in a single service. When the variable isn't set, the system
+ * property of the same name is used instead, lowercased and with
+ * "VECTORIMPL_" turned into "vectorimpl.", e.g. vectorimpl.pool.
+ */
+
+//! true for "1", "y", "yes", "true" or "on", false for their opposites
+bool    vectorConfigBool(const char* name, bool defaultValue);
+
+//! a byte or item count, with an optional k/m/g suffix
+size_t  vectorConfigSize(const char* name, size_t defaultValue);
+
+//! a string, copied into buffer (truncated to size - 1 characters)
+const char* vectorConfigString(const char* name, const char* defaultValue,
+        char* buffer, size_t size);
+
+/*! true if the process resolves all count symbols (mangled names) to the
+ *  shim, rather than to libutils' own: features that must see every change
+ *  to a Vector's storage only work where the shim is preloaded, not where
+ *  LD_SHIM_LIBS only binds it to a few libraries. Otherwise logs why
+ *  feature stays off */
+bool    vectorShimResolves(const char* feature, const char* const* symbols, size_t count);
+
+}; // namespace android
+
+#endif // NV_VECTOR_CONFIG_H
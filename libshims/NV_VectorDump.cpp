@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VectorDump"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "NV_VectorConfig.h"
+#include "NV_VectorDump.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+namespace {
+
+const char kDefaultDumpDir[] = "/data/misc/vectorimpl";
+
+const int kMaxDumps = 8;
+
+pthread_once_t gOnce = PTHREAD_ONCE_INIT;
+pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+vector_dump_t gDumps[kMaxDumps];
+int gNumDumps = 0;
+
+// leaves room for the file names
+char gDumpDir[PATH_MAX - 64];
+
+// the signal handler only wakes the dump thread up
+int gDumpPipe[2] = { -1, -1 };
+
+void dumpAll()
+{
+    pthread_mutex_lock(&gLock);
+    for (int i = 0 ; i < gNumDumps ; i++) {
+        gDumps[i]();
+    }
+    pthread_mutex_unlock(&gLock);
+}
+
+void dumpSignalHandler(int)
+{
+    const int savedErrno = errno;
+    const char c = 0;
+    if (write(gDumpPipe[1], &c, 1) < 0) {
+        // the pipe is full: a dump is pending already
+    }
+    errno = savedErrno;
+}
+
+void* dumpThread(void*)
+{
+    char c;
+    for (;;) {
+        const ssize_t n = read(gDumpPipe[0], &c, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        dumpAll();
+    }
+    return 0;
+}
+
+// Hooks the dump signal, unless the process already handles it, and starts
+// the thread doing the actual dumps: writing a file isn't something a
+// signal handler can do.
+void installDumpSignal(int signo)
+{
+    struct sigaction old;
+    if (sigaction(signo, NULL, &old) ||
+            (old.sa_handler != SIG_DFL && old.sa_handler != SIG_IGN)) {
+        ALOGW("signal %d is taken, no dumps on signal", signo);
+        return;
+    }
+    if (pipe2(gDumpPipe, O_CLOEXEC | O_NONBLOCK)) {
+        ALOGW("can't create the dump pipe: %s", strerror(errno));
+        return;
+    }
+    // only the writing end may not block
+    fcntl(gDumpPipe[0], F_SETFL, fcntl(gDumpPipe[0], F_GETFL) & ~O_NONBLOCK);
+
+    // the dump thread must not take any of the process' signals
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    const int err = pthread_create(&thread, &attr, dumpThread, NULL);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (err) {
+        ALOGW("can't start the dump thread: %s", strerror(err));
+        return;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = dumpSignalHandler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(signo, &sa, NULL);
+}
+
+void initDump()
+{
+    vectorConfigString("VECTORIMPL_DUMP_DIR", kDefaultDumpDir, gDumpDir, sizeof(gDumpDir));
+
+    const size_t signo = vectorConfigSize("VECTORIMPL_DUMP_SIGNAL", SIGUSR2);
+    if (signo >= NSIG) {
+        ALOGW("VECTORIMPL_DUMP_SIGNAL=%zu isn't a signal", signo);
+    } else if (signo) {
+        installDumpSignal(int(signo));
+    }
+    atexit(dumpAll);
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+status_t vectorDumpRegister(vector_dump_t dump)
+{
+    pthread_once(&gOnce, initDump);
+    status_t err = NO_ERROR;
+    pthread_mutex_lock(&gLock);
+    if (gNumDumps < kMaxDumps) {
+        gDumps[gNumDumps++] = dump;
+    } else {
+        err = NO_MEMORY;
+    }
+    pthread_mutex_unlock(&gLock);
+    return err;
+}
+
+int vectorDumpOpen(const char* suffix)
+{
+    pthread_once(&gOnce, initDump);
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/vectorimpl-%d%s", gDumpDir, getpid(), suffix);
+    // a fresh file every time: an earlier dump, or whatever was planted
+    // under its name, goes away first, and O_EXCL | O_NOFOLLOW make sure
+    // the open doesn't follow anything put back in the meantime
+    if (unlink(path) && errno != ENOENT) {
+        const int err = errno;
+        ALOGW("can't replace %s: %s", path, strerror(err));
+        return -err;
+    }
+    const int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        const int err = errno;
+        ALOGW("can't write %s: %s", path, strerror(err));
+        return -err;
+    }
+    return fd;
+}
+
+}; // namespace android
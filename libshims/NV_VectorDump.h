@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTOR_DUMP_H
+#define NV_VECTOR_DUMP_H
+
+#include <sys/types.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Where and when the debugging features of the shim write their dumps.
+ *
+ * Dumps go to <dir>/vectorimpl-<pid><suffix>, when the process exits and
+ * every time it receives the dump signal, e.g.
+ *   adb shell kill -USR2 $(pidof mediaserver)
+ * The signal handler only wakes up a thread of the shim, which does the
+ * actual writing. The signal is left alone if the process handles it.
+ *
+ * Tunables:
+ *   VECTORIMPL_DUMP_DIR        (default /data/misc/vectorimpl)
+ *   VECTORIMPL_DUMP_SIGNAL     (default SIGUSR2, 0 for none)
+ */
+
+typedef void (*vector_dump_t)();
+
+//! calls dump at exit and on every dump signal
+status_t    vectorDumpRegister(vector_dump_t dump);
+
+/*! creates the dump file with that suffix, replacing the previous one,
+ *  and opens it for writing: -errno on failure */
+int         vectorDumpOpen(const char* suffix);
+
+}; // namespace android
+
+#endif // NV_VECTOR_DUMP_H
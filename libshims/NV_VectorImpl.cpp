@@ -26,6 +26,15 @@
 #include <utils/Errors.h>
 #include <utils/SharedBuffer.h>
 #include "NV_VectorImpl.h"
+#include "NV_VectorKernels.h"
+#include "NV_VectorPolicy.h"
+#include "NV_VectorPool.h"
+#include "NV_VectorRealtime.h"
+#include "NV_VectorReclaimer.h"
+#include "NV_VectorSlack.h"
+#include "NV_VectorTelemetry.h"
+#include "NV_VectorTrace.h"
+#include "NV_VectorWorkers.h"
 
 /*****************************************************************************/
 
@@ -40,22 +49,41 @@ static inline size_t max(size_t a, size_t b) {
     return a>b ? a : b;
 }
 
+// moving is copying then destroying the source, so it's a plain memmove()
+// when both are trivial, or when the subclass says so
+static inline bool hasTrivialMove(uint32_t flags) {
+    const uint32_t trivial = VectorImpl::HAS_TRIVIAL_COPY | VectorImpl::HAS_TRIVIAL_DTOR;
+    return (flags & VectorImpl::HAS_TRIVIAL_MOVE) || (flags & trivial) == trivial;
+}
+
 // ----------------------------------------------------------------------------
 
 VectorImpl::VectorImpl(size_t itemSize, uint32_t flags)
     : mStorage(0), mCount(0), mFlags(flags), mItemSize(itemSize)
 {
+    _forgetStaleReservation();
 }
 
 VectorImpl::VectorImpl(const VectorImpl& rhs)
     :   mStorage(rhs.mStorage), mCount(rhs.mCount),
         mFlags(rhs.mFlags), mItemSize(rhs.mItemSize)
 {
+    _forgetStaleReservation();
     if (mStorage) {
         SharedBuffer::bufferFromData(mStorage)->acquire();
     }
 }
 
+VectorImpl::VectorImpl(VectorImpl&& rhs)
+    :   mStorage(rhs.mStorage), mCount(rhs.mCount),
+        mFlags(rhs.mFlags), mItemSize(rhs.mItemSize)
+{
+    // the reservation goes with the storage
+    VectorRealtime::moveReserved(&rhs, this);
+    rhs.mStorage = 0;
+    rhs.mCount = 0;
+}
+
 VectorImpl::~VectorImpl()
 {
     ALOGW_IF(mCount,
@@ -63,10 +91,16 @@ VectorImpl::~VectorImpl()
         " in their destructor. Leaking %d bytes.",
         this, (int)(mCount*mItemSize));
     // We can't call _do_destroy() here because the vtable is already gone.
+
+    // a reservation belongs to the object, not to its storage
+    if (VectorRealtime::reservedCapacity(this)) {
+        VectorRealtime::setReserved(this, 0);
+    }
 }
 
 VectorImpl& VectorImpl::operator = (const VectorImpl& rhs)
 {
+    VectorSlackScope slack(this);
     LOG_ALWAYS_FATAL_IF(mItemSize != rhs.mItemSize,
         "Vector<> have different types (this=%p, rhs=%p)", this, &rhs);
     if (this != &rhs) {
@@ -83,15 +117,47 @@ VectorImpl& VectorImpl::operator = (const VectorImpl& rhs)
     return *this;
 }
 
+VectorImpl& VectorImpl::operator = (VectorImpl&& rhs)
+{
+    VectorSlackScope slack(this);
+    LOG_ALWAYS_FATAL_IF(mItemSize != rhs.mItemSize,
+        "Vector<> have different types (this=%p, rhs=%p)", this, &rhs);
+    if (this != &rhs) {
+        release_storage();
+        VectorRealtime::moveReserved(&rhs, this);
+        mStorage = rhs.mStorage;
+        mCount = rhs.mCount;
+        rhs.mStorage = 0;
+        rhs.mCount = 0;
+    }
+    return *this;
+}
+
+void VectorImpl::swap(VectorImpl& rhs)
+{
+    LOG_ALWAYS_FATAL_IF(mItemSize != rhs.mItemSize,
+        "Vector<> have different types (this=%p, rhs=%p)", this, &rhs);
+    void* storage = mStorage;
+    size_t count = mCount;
+    mStorage = rhs.mStorage;
+    mCount = rhs.mCount;
+    rhs.mStorage = storage;
+    rhs.mCount = count;
+    VectorRealtime::swapReserved(this, &rhs);
+}
+
 void* VectorImpl::editArrayImpl()
 {
+    VectorSlackScope slack(this);
     if (mStorage) {
         const SharedBuffer* sb = SharedBuffer::bufferFromData(mStorage);
         SharedBuffer* editable = sb->attemptEdit();
         if (editable == 0) {
             // If we're here, we're not the only owner of the buffer.
             // We must make a copy of it.
-            editable = SharedBuffer::alloc(sb->size());
+            VectorTraceScope trace(VectorTrace::COPY_ON_WRITE, mCount, mItemSize);
+            VectorRealtime::check(VectorRealtime::COPY_ON_WRITE, capacity(), mItemSize);
+            editable = VectorPool::alloc(sb->size());
             // Fail instead of returning a pointer to storage that's not
             // editable. Otherwise we'd be editing the contents of a buffer
             // for which we're not the only owner, which is undefined behaviour.
@@ -99,6 +165,10 @@ void* VectorImpl::editArrayImpl()
             _do_copy(editable->data(), mStorage, mCount);
             release_storage();
             mStorage = editable->data();
+            VectorTelemetry::record(VectorTelemetry::EDIT, mItemSize, mCount * mItemSize,
+                    true, editable->size() / mItemSize);
+        } else {
+            VectorTelemetry::record(VectorTelemetry::EDIT, mItemSize, 0, false);
         }
     }
     return mStorage;
@@ -158,6 +228,698 @@ ssize_t VectorImpl::insertAt(const void* item, size_t index, size_t numItems)
     return where ? index : (ssize_t)NO_MEMORY;
 }
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Stable merge sort backing VectorImpl::sort(), after the run-adaptive
+ * "timsort" from CPython's listsort. Natural runs are detected (strictly
+ * descending runs are reversed in place), short runs are extended to a
+ * minimum length with binary insertion sort, and runs are merged through
+ * a scratch buffer; once one run keeps winning, the merge switches to
+ * galloping and moves whole blocks at a time.
+ *
+ * Items are relocated (copy-construct + destroy) rather than assigned, so
+ * this works for non-trivial types; for HAS_TRIVIAL_MOVE items, or
+ * HAS_TRIVIAL_COPY/HAS_TRIVIAL_DTOR ones, every relocation boils down to a
+ * memcpy.
+ */
+class VectorImplSorter
+{
+public:
+    VectorImplSorter(const VectorImpl& vector, VectorImpl::compar_r_t cmp,
+            void* state, void* scratch)
+        : mVector(vector), mCmp(cmp), mState(state),
+          mItemSize(vector.mItemSize), mArray(0),
+          mScratch(reinterpret_cast<char*>(scratch)),
+          mMinGallop(MIN_GALLOP), mPending(0)
+    {
+    }
+
+    // number of items the scratch buffer must be able to hold
+    static size_t scratchItems(size_t count) {
+        return count < MIN_MERGE ? 1 : count / 2;
+    }
+
+    void sort(void* array, size_t count);
+
+private:
+    enum {
+        MIN_MERGE   = 32,   // arrays shorter than this are binary-insertion sorted
+        MIN_GALLOP  = 7,    // initial threshold for entering galloping mode
+        MAX_PENDING = 85    // enough pending runs for any size_t-sized array
+    };
+
+    inline char* at(ssize_t index) const {
+        return mArray + index*mItemSize;
+    }
+    inline char* tmp(ssize_t index) const {
+        return mScratch + index*mItemSize;
+    }
+    inline int compare(const void* lhs, const void* rhs) const {
+        return mCmp(lhs, rhs, mState);
+    }
+
+    // moves num items to uninitialized, non-overlapping storage
+    inline void relocate(void* dest, void* from, size_t num) const {
+        mVector._do_relocate(dest, from, num);
+    }
+
+    static size_t minRunLength(size_t n);
+    size_t countRunAndMakeAscending(size_t lo, size_t hi);
+    void reverseRange(size_t lo, size_t hi);
+    void binarySort(size_t lo, size_t hi, size_t start);
+    ssize_t gallopLeft(const void* key, const char* base, ssize_t len, ssize_t hint) const;
+    ssize_t gallopRight(const void* key, const char* base, ssize_t len, ssize_t hint) const;
+    void mergeCollapse();
+    void mergeForceCollapse();
+    void mergeAt(size_t i);
+    void mergeLo(ssize_t base1, ssize_t len1, ssize_t base2, ssize_t len2);
+    void mergeHi(ssize_t base1, ssize_t len1, ssize_t base2, ssize_t len2);
+
+    const VectorImpl&           mVector;
+    VectorImpl::compar_r_t      mCmp;
+    void*                       mState;
+    const size_t                mItemSize;
+    char*                       mArray;
+    char*                       mScratch;
+    ssize_t                     mMinGallop;
+    size_t                      mPending;
+    size_t                      mRunBase[MAX_PENDING];
+    size_t                      mRunLen[MAX_PENDING];
+};
+
+void VectorImplSorter::sort(void* array, size_t count)
+{
+    mArray = reinterpret_cast<char*>(array);
+    if (count < 2)
+        return;
+
+    if (count < MIN_MERGE) {
+        const size_t run = countRunAndMakeAscending(0, count);
+        binarySort(0, count, run);
+        return;
+    }
+
+    const size_t minRun = minRunLength(count);
+    size_t lo = 0;
+    size_t remaining = count;
+    do {
+        size_t run = countRunAndMakeAscending(lo, count);
+        if (run < minRun) {
+            const size_t force = remaining <= minRun ? remaining : minRun;
+            binarySort(lo, lo + force, lo + run);
+            run = force;
+        }
+        mRunBase[mPending] = lo;
+        mRunLen[mPending] = run;
+        mPending++;
+        mergeCollapse();
+        lo += run;
+        remaining -= run;
+    } while (remaining != 0);
+    mergeForceCollapse();
+}
+
+size_t VectorImplSorter::minRunLength(size_t n)
+{
+    size_t r = 0;
+    while (n >= MIN_MERGE) {
+        r |= (n & 1);
+        n >>= 1;
+    }
+    return n + r;
+}
+
+size_t VectorImplSorter::countRunAndMakeAscending(size_t lo, size_t hi)
+{
+    size_t runHi = lo + 1;
+    if (runHi == hi)
+        return 1;
+
+    // only strictly descending runs are reversed, to keep the sort stable
+    if (compare(at(runHi), at(lo)) < 0) {
+        runHi++;
+        while (runHi < hi && compare(at(runHi), at(runHi - 1)) < 0)
+            runHi++;
+        reverseRange(lo, runHi);
+    } else {
+        runHi++;
+        while (runHi < hi && compare(at(runHi), at(runHi - 1)) >= 0)
+            runHi++;
+    }
+    return runHi - lo;
+}
+
+void VectorImplSorter::reverseRange(size_t lo, size_t hi)
+{
+    void* const t = tmp(0);
+    hi--;
+    while (lo < hi) {
+        relocate(t, at(lo), 1);
+        relocate(at(lo), at(hi), 1);
+        relocate(at(hi), t, 1);
+        lo++;
+        hi--;
+    }
+}
+
+void VectorImplSorter::binarySort(size_t lo, size_t hi, size_t start)
+{
+    void* const pivot = tmp(0);
+    if (start == lo)
+        start++;
+    for ( ; start < hi ; start++) {
+        // find the rightmost slot the item can go to
+        size_t left = lo;
+        size_t right = start;
+        while (left < right) {
+            const size_t mid = left + (right - left) / 2;
+            if (compare(at(start), at(mid)) < 0) {
+                right = mid;
+            } else {
+                left = mid + 1;
+            }
+        }
+        const size_t n = start - left;
+        if (n) {
+            relocate(pivot, at(start), 1);
+            mVector._do_move_forward(at(left + 1), at(left), n);
+            relocate(at(left), pivot, 1);
+        }
+    }
+}
+
+/*
+ * Returns k in [0, len] such that base[k-1] < key <= base[k], starting the
+ * search at base[hint] and galloping away from it.
+ */
+ssize_t VectorImplSorter::gallopLeft(const void* key, const char* base,
+        ssize_t len, ssize_t hint) const
+{
+    ssize_t lastOfs = 0;
+    ssize_t ofs = 1;
+    if (compare(key, base + hint*mItemSize) > 0) {
+        // gallop right until base[hint+lastOfs] < key <= base[hint+ofs]
+        const ssize_t maxOfs = len - hint;
+        while (ofs < maxOfs && compare(key, base + (hint + ofs)*mItemSize) > 0) {
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxOfs)
+            ofs = maxOfs;
+        lastOfs += hint;
+        ofs += hint;
+    } else {
+        // gallop left until base[hint-ofs] < key <= base[hint-lastOfs]
+        const ssize_t maxOfs = hint + 1;
+        while (ofs < maxOfs && compare(key, base + (hint - ofs)*mItemSize) <= 0) {
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxOfs)
+            ofs = maxOfs;
+        const ssize_t t = lastOfs;
+        lastOfs = hint - ofs;
+        ofs = hint - t;
+    }
+
+    // base[lastOfs] < key <= base[ofs], finish with a binary search
+    lastOfs++;
+    while (lastOfs < ofs) {
+        const ssize_t m = lastOfs + (ofs - lastOfs) / 2;
+        if (compare(key, base + m*mItemSize) > 0) {
+            lastOfs = m + 1;
+        } else {
+            ofs = m;
+        }
+    }
+    return ofs;
+}
+
+/*
+ * Like gallopLeft(), except that if the range contains items equal to key,
+ * returns the index after the rightmost one.
+ */
+ssize_t VectorImplSorter::gallopRight(const void* key, const char* base,
+        ssize_t len, ssize_t hint) const
+{
+    ssize_t lastOfs = 0;
+    ssize_t ofs = 1;
+    if (compare(key, base + hint*mItemSize) < 0) {
+        // gallop left until base[hint-ofs] <= key < base[hint-lastOfs]
+        const ssize_t maxOfs = hint + 1;
+        while (ofs < maxOfs && compare(key, base + (hint - ofs)*mItemSize) < 0) {
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxOfs)
+            ofs = maxOfs;
+        const ssize_t t = lastOfs;
+        lastOfs = hint - ofs;
+        ofs = hint - t;
+    } else {
+        // gallop right until base[hint+lastOfs] <= key < base[hint+ofs]
+        const ssize_t maxOfs = len - hint;
+        while (ofs < maxOfs && compare(key, base + (hint + ofs)*mItemSize) >= 0) {
+            lastOfs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxOfs)
+            ofs = maxOfs;
+        lastOfs += hint;
+        ofs += hint;
+    }
+
+    // base[lastOfs] <= key < base[ofs], finish with a binary search
+    lastOfs++;
+    while (lastOfs < ofs) {
+        const ssize_t m = lastOfs + (ofs - lastOfs) / 2;
+        if (compare(key, base + m*mItemSize) < 0) {
+            ofs = m;
+        } else {
+            lastOfs = m + 1;
+        }
+    }
+    return ofs;
+}
+
+void VectorImplSorter::mergeCollapse()
+{
+    // keeps the run lengths on the stack growing faster than fibonacci,
+    // which bounds the stack depth and keeps the merges balanced.
+    while (mPending > 1) {
+        size_t n = mPending - 2;
+        if ((n > 0 && mRunLen[n-1] <= mRunLen[n] + mRunLen[n+1]) ||
+            (n > 1 && mRunLen[n-2] <= mRunLen[n-1] + mRunLen[n])) {
+            if (mRunLen[n-1] < mRunLen[n+1])
+                n--;
+        } else if (mRunLen[n] > mRunLen[n+1]) {
+            break;
+        }
+        mergeAt(n);
+    }
+}
+
+void VectorImplSorter::mergeForceCollapse()
+{
+    while (mPending > 1) {
+        size_t n = mPending - 2;
+        if (n > 0 && mRunLen[n-1] < mRunLen[n+1])
+            n--;
+        mergeAt(n);
+    }
+}
+
+void VectorImplSorter::mergeAt(size_t i)
+{
+    ssize_t base1 = mRunBase[i];
+    ssize_t len1 = mRunLen[i];
+    const ssize_t base2 = mRunBase[i+1];
+    ssize_t len2 = mRunLen[i+1];
+
+    mRunLen[i] = len1 + len2;
+    if (i == mPending - 3) {
+        mRunBase[i+1] = mRunBase[i+2];
+        mRunLen[i+1] = mRunLen[i+2];
+    }
+    mPending--;
+
+    // items of run1 that are already in place can be skipped...
+    const ssize_t k = gallopRight(at(base2), at(base1), len1, 0);
+    base1 += k;
+    len1 -= k;
+    if (len1 == 0)
+        return;
+
+    // ...and so can the items of run2 that are already in place
+    len2 = gallopLeft(at(base1 + len1 - 1), at(base2), len2, len2 - 1);
+    if (len2 == 0)
+        return;
+
+    if (len1 <= len2) {
+        mergeLo(base1, len1, base2, len2);
+    } else {
+        mergeHi(base1, len1, base2, len2);
+    }
+}
+
+/*
+ * Merges two adjacent runs, run1 being the shorter one. run1 is moved to
+ * the scratch buffer and the result is built from the left.
+ */
+void VectorImplSorter::mergeLo(ssize_t base1, ssize_t len1, ssize_t base2, ssize_t len2)
+{
+    relocate(tmp(0), at(base1), len1);
+    ssize_t cursor1 = 0;
+    ssize_t cursor2 = base2;
+    ssize_t dest = base1;
+
+    relocate(at(dest++), at(cursor2++), 1);
+    if (--len2 == 0) {
+        relocate(at(dest), tmp(cursor1), len1);
+        return;
+    }
+    if (len1 == 1) {
+        mVector._do_move_backward(at(dest), at(cursor2), len2);
+        relocate(at(dest + len2), tmp(cursor1), 1);
+        return;
+    }
+
+    ssize_t minGallop = mMinGallop;
+    while (true) {
+        ssize_t count1 = 0;     // number of times in a row that run1 won
+        ssize_t count2 = 0;     // number of times in a row that run2 won
+
+        // straightforward merge until one run starts winning consistently
+        do {
+            if (compare(at(cursor2), tmp(cursor1)) < 0) {
+                relocate(at(dest++), at(cursor2++), 1);
+                count2++;
+                count1 = 0;
+                if (--len2 == 0)
+                    goto done;
+            } else {
+                relocate(at(dest++), tmp(cursor1++), 1);
+                count1++;
+                count2 = 0;
+                if (--len1 == 1)
+                    goto done;
+            }
+        } while ((count1 | count2) < minGallop);
+
+        // galloping may be a huge win, keep at it until it stops paying off
+        do {
+            count1 = gallopRight(at(cursor2), tmp(cursor1), len1, 0);
+            if (count1 != 0) {
+                relocate(at(dest), tmp(cursor1), count1);
+                dest += count1;
+                cursor1 += count1;
+                len1 -= count1;
+                if (len1 <= 1)
+                    goto done;
+            }
+            relocate(at(dest++), at(cursor2++), 1);
+            if (--len2 == 0)
+                goto done;
+
+            count2 = gallopLeft(tmp(cursor1), at(cursor2), len2, 0);
+            if (count2 != 0) {
+                mVector._do_move_backward(at(dest), at(cursor2), count2);
+                dest += count2;
+                cursor2 += count2;
+                len2 -= count2;
+                if (len2 == 0)
+                    goto done;
+            }
+            relocate(at(dest++), tmp(cursor1++), 1);
+            if (--len1 == 1)
+                goto done;
+            minGallop--;
+        } while (count1 >= MIN_GALLOP || count2 >= MIN_GALLOP);
+        if (minGallop < 0)
+            minGallop = 0;
+        minGallop += 2;     // penalize leaving galloping mode
+    }
+
+done:
+    mMinGallop = minGallop < 1 ? 1 : minGallop;
+    if (len1 == 1) {
+        mVector._do_move_backward(at(dest), at(cursor2), len2);
+        relocate(at(dest + len2), tmp(cursor1), 1);
+    } else if (len1 > 0) {
+        // len1 can only be 0 with an inconsistent comparator, in which
+        // case run2 is already where it belongs.
+        relocate(at(dest), tmp(cursor1), len1);
+    }
+}
+
+/*
+ * Merges two adjacent runs, run2 being the shorter one. run2 is moved to
+ * the scratch buffer and the result is built from the right.
+ */
+void VectorImplSorter::mergeHi(ssize_t base1, ssize_t len1, ssize_t base2, ssize_t len2)
+{
+    relocate(tmp(0), at(base2), len2);
+    ssize_t cursor1 = base1 + len1 - 1;
+    ssize_t cursor2 = len2 - 1;
+    ssize_t dest = base2 + len2 - 1;
+
+    relocate(at(dest--), at(cursor1--), 1);
+    if (--len1 == 0) {
+        relocate(at(dest - (len2 - 1)), tmp(0), len2);
+        return;
+    }
+    if (len2 == 1) {
+        dest -= len1;
+        cursor1 -= len1;
+        mVector._do_move_forward(at(dest + 1), at(cursor1 + 1), len1);
+        relocate(at(dest), tmp(cursor2), 1);
+        return;
+    }
+
+    ssize_t minGallop = mMinGallop;
+    while (true) {
+        ssize_t count1 = 0;     // number of times in a row that run1 won
+        ssize_t count2 = 0;     // number of times in a row that run2 won
+
+        do {
+            if (compare(tmp(cursor2), at(cursor1)) < 0) {
+                relocate(at(dest--), at(cursor1--), 1);
+                count1++;
+                count2 = 0;
+                if (--len1 == 0)
+                    goto done;
+            } else {
+                relocate(at(dest--), tmp(cursor2--), 1);
+                count2++;
+                count1 = 0;
+                if (--len2 == 1)
+                    goto done;
+            }
+        } while ((count1 | count2) < minGallop);
+
+        do {
+            count1 = len1 - gallopRight(tmp(cursor2), at(base1), len1, len1 - 1);
+            if (count1 != 0) {
+                dest -= count1;
+                cursor1 -= count1;
+                len1 -= count1;
+                mVector._do_move_forward(at(dest + 1), at(cursor1 + 1), count1);
+                if (len1 == 0)
+                    goto done;
+            }
+            relocate(at(dest--), tmp(cursor2--), 1);
+            if (--len2 == 1)
+                goto done;
+
+            count2 = len2 - gallopLeft(at(cursor1), tmp(0), len2, len2 - 1);
+            if (count2 != 0) {
+                dest -= count2;
+                cursor2 -= count2;
+                len2 -= count2;
+                relocate(at(dest + 1), tmp(cursor2 + 1), count2);
+                if (len2 <= 1)
+                    goto done;
+            }
+            relocate(at(dest--), at(cursor1--), 1);
+            if (--len1 == 0)
+                goto done;
+            minGallop--;
+        } while (count1 >= MIN_GALLOP || count2 >= MIN_GALLOP);
+        if (minGallop < 0)
+            minGallop = 0;
+        minGallop += 2;     // penalize leaving galloping mode
+    }
+
+done:
+    mMinGallop = minGallop < 1 ? 1 : minGallop;
+    if (len2 == 1) {
+        dest -= len1;
+        cursor1 -= len1;
+        mVector._do_move_forward(at(dest + 1), at(cursor1 + 1), len1);
+        relocate(at(dest), tmp(cursor2), 1);
+    } else if (len2 > 0) {
+        // len2 can only be 0 with an inconsistent comparator, in which
+        // case run1 is already where it belongs.
+        relocate(at(dest - (len2 - 1)), tmp(0), len2);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Parallel front-end of VectorImplSorter for large arrays. The array is
+ * cut into one chunk per thread and the chunks are sorted concurrently.
+ * They're then merged pairwise, round after round, between the array and
+ * a scratch buffer of the same size. Each merge is split further at
+ * points found by binary search (the "merge path"), so every thread has
+ * work until the last round. Ties go to the left run, which makes the
+ * result exactly the one of the serial sort.
+ */
+class VectorImplParallelSorter
+{
+public:
+    VectorImplParallelSorter(const VectorImpl& vector, VectorImpl::compar_r_t cmp,
+            void* state, void* scratch)
+        : mVector(vector), mCmp(cmp), mState(state),
+          mItemSize(vector.mItemSize), mArray(0),
+          mScratch(reinterpret_cast<char*>(scratch)), mNumTasks(0)
+    {
+    }
+
+    // the scratch buffer holds count items
+    void sort(void* array, size_t count, size_t threads);
+
+private:
+    // produces items [begin, end) of the merge of left and right into dest
+    struct MergeTask {
+        char*   left;
+        size_t  leftCount;
+        char*   right;
+        size_t  rightCount;
+        size_t  begin;
+        size_t  end;
+        char*   dest;
+    };
+
+    inline int compare(const void* lhs, const void* rhs) const {
+        return mCmp(lhs, rhs, mState);
+    }
+    inline void relocate(void* dest, void* from, size_t num) const {
+        mVector._do_relocate(dest, from, num);
+    }
+
+    void addTasks(char* left, size_t leftCount, char* right, size_t rightCount,
+            char* dest, size_t pieces);
+    size_t leftRank(const MergeTask& task, size_t k) const;
+    static void sortChunk(void* self, size_t index);
+    static void merge(void* self, size_t index);
+
+    const VectorImpl&           mVector;
+    VectorImpl::compar_r_t      mCmp;
+    void*                       mState;
+    const size_t                mItemSize;
+    char*                       mArray;
+    char*                       mScratch;
+    size_t                      mRunBase[VectorWorkers::MAX_THREADS + 1];
+    size_t                      mNumTasks;
+    MergeTask                   mTasks[VectorWorkers::MAX_THREADS + 1];
+};
+
+void VectorImplParallelSorter::sort(void* array, size_t count, size_t threads)
+{
+    mArray = reinterpret_cast<char*>(array);
+    for (size_t i = 0 ; i <= threads ; i++) {
+        mRunBase[i] = count * i / threads;
+    }
+    VectorWorkers::run(sortChunk, this, threads);
+
+    const size_t s = mItemSize;
+    char* from = mArray;
+    char* to = mScratch;
+    size_t runs = threads;
+    while (runs > 1) {
+        const size_t pairs = runs / 2;
+        const size_t pieces = threads / pairs;
+        mNumTasks = 0;
+        for (size_t p = 0 ; p < pairs ; p++) {
+            const size_t lo = mRunBase[2*p];
+            const size_t mid = mRunBase[2*p + 1];
+            const size_t hi = mRunBase[2*p + 2];
+            addTasks(from + lo*s, mid - lo, from + mid*s, hi - mid, to + lo*s, pieces);
+        }
+        if (runs & 1) {
+            const size_t lo = mRunBase[runs - 1];
+            addTasks(from + lo*s, count - lo, 0, 0, to + lo*s, 1);
+        }
+        VectorWorkers::run(merge, this, mNumTasks);
+
+        for (size_t r = 0 ; r < (runs + 1) / 2 ; r++) {
+            mRunBase[r] = mRunBase[2*r];
+        }
+        runs = (runs + 1) / 2;
+        mRunBase[runs] = count;
+        char* const swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != mArray) {
+        mNumTasks = 0;
+        addTasks(from, count, 0, 0, mArray, threads);
+        VectorWorkers::run(merge, this, mNumTasks);
+    }
+}
+
+void VectorImplParallelSorter::addTasks(char* left, size_t leftCount,
+        char* right, size_t rightCount, char* dest, size_t pieces)
+{
+    const size_t total = leftCount + rightCount;
+    for (size_t q = 0 ; q < pieces ; q++) {
+        MergeTask& task = mTasks[mNumTasks++];
+        task.left = left;
+        task.leftCount = leftCount;
+        task.right = right;
+        task.rightCount = rightCount;
+        task.begin = total * q / pieces;
+        task.end = total * (q + 1) / pieces;
+        task.dest = dest;
+    }
+}
+
+size_t VectorImplParallelSorter::leftRank(const MergeTask& task, size_t k) const
+{
+    // how many of the first k merged items come from the left run: the
+    // smallest i after which right[k - i - 1] < left[i]
+    size_t lo = k > task.rightCount ? k - task.rightCount : 0;
+    size_t hi = k < task.leftCount ? k : task.leftCount;
+    while (lo < hi) {
+        const size_t i = lo + (hi - lo)/2;
+        if (compare(task.right + (k - i - 1)*mItemSize, task.left + i*mItemSize) >= 0) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
+    }
+    return lo;
+}
+
+void VectorImplParallelSorter::sortChunk(void* self, size_t index)
+{
+    VectorImplParallelSorter* sorter = static_cast<VectorImplParallelSorter*>(self);
+    const size_t lo = sorter->mRunBase[index];
+    const size_t hi = sorter->mRunBase[index + 1];
+    const size_t s = sorter->mItemSize;
+    // the chunk's own part of the scratch buffer is more than it needs
+    VectorImplSorter(sorter->mVector, sorter->mCmp, sorter->mState,
+            sorter->mScratch + lo*s).sort(sorter->mArray + lo*s, hi - lo);
+}
+
+void VectorImplParallelSorter::merge(void* self, size_t index)
+{
+    const VectorImplParallelSorter* sorter = static_cast<VectorImplParallelSorter*>(self);
+    const MergeTask& task = sorter->mTasks[index];
+    const size_t s = sorter->mItemSize;
+    size_t l = sorter->leftRank(task, task.begin);
+    size_t r = task.begin - l;
+    const size_t lEnd = sorter->leftRank(task, task.end);
+    const size_t rEnd = task.end - lEnd;
+    char* dest = task.dest + task.begin*s;
+    while (l < lEnd && r < rEnd) {
+        if (sorter->compare(task.right + r*s, task.left + l*s) < 0) {
+            sorter->relocate(dest, task.right + r*s, 1);
+            r++;
+        } else {
+            sorter->relocate(dest, task.left + l*s, 1);
+            l++;
+        }
+        dest += s;
+    }
+    sorter->relocate(dest, task.left + l*s, lEnd - l);
+    dest += (lEnd - l)*s;
+    sorter->relocate(dest, task.right + r*s, rEnd - r);
+}
+
 static int sortProxy(const void* lhs, const void* rhs, void* func)
 {
     return (*(VectorImpl::compar_t)func)(lhs, rhs);
@@ -170,54 +932,144 @@ status_t VectorImpl::sort(VectorImpl::compar_t cmp)
 
 status_t VectorImpl::sort(VectorImpl::compar_r_t cmp, void* state)
 {
-    // the sort must be stable. we're using insertion sort which
-    // is well suited for small and already sorted arrays
-    // for big arrays, it could be better to use mergesort
-    const ssize_t count = size();
+    // the sort must be stable. we're using a run-adaptive merge sort
+    // (see VectorImplSorter below) which degenerates to a binary insertion
+    // sort for small arrays and to a single pass for already sorted ones.
+    const size_t count = size();
+    VectorTraceScope trace(VectorTrace::SORT, count, mItemSize);
     if (count > 1) {
-        void* array = const_cast<void*>(arrayImpl());
-        void* temp = 0;
-        ssize_t i = 1;
-        while (i < count) {
-            void* item = reinterpret_cast<char*>(array) + mItemSize*(i);
-            void* curr = reinterpret_cast<char*>(array) + mItemSize*(i-1);
-            if (cmp(curr, item, state) > 0) {
-
-                if (!temp) {
-                    // we're going to have to modify the array...
-                    array = editArrayImpl();
-                    if (!array) return NO_MEMORY;
-                    temp = malloc(mItemSize);
-                    if (!temp) return NO_MEMORY;
-                    item = reinterpret_cast<char*>(array) + mItemSize*(i);
-                    curr = reinterpret_cast<char*>(array) + mItemSize*(i-1);
-                } else {
-                    _do_destroy(temp, 1);
-                }
+        // don't make the storage unique if the array is already sorted
+        const char* array = reinterpret_cast<const char*>(arrayImpl());
+        size_t i = 1;
+        while (i < count && cmp(array + mItemSize*(i-1), array + mItemSize*i, state) <= 0) {
+            i++;
+        }
+        if (i == count) {
+            VectorTelemetry::record(VectorTelemetry::SORT, mItemSize, 0, false);
+            return NO_ERROR;
+        }
 
-                _do_copy(temp, item, 1);
+        // large arrays are split over the workers, see VectorImplParallelSorter
+        const size_t parallelMin = VectorWorkers::sortParallelMin();
+        const size_t threads = (parallelMin && count >= parallelMin) ?
+                VectorWorkers::concurrency() : 1;
+
+        // the scratch buffer is allocated once for the whole sort
+        const size_t scratchItems = threads > 1 ? count : VectorImplSorter::scratchItems(count);
+        VectorRealtime::check(VectorRealtime::SCRATCH, scratchItems, mItemSize);
+        void* scratch = malloc(scratchItems * mItemSize);
+        if (!scratch) return NO_MEMORY;
+        void* edited = editArrayImpl();
+        if (!edited) {
+            free(scratch);
+            return NO_MEMORY;
+        }
+        if (threads > 1) {
+            VectorImplParallelSorter(*this, cmp, state, scratch).sort(edited, count, threads);
+        } else {
+            VectorImplSorter(*this, cmp, state, scratch).sort(edited, count);
+        }
+        free(scratch);
+        VectorTelemetry::record(VectorTelemetry::SORT, mItemSize, count * mItemSize, false);
+    }
+    return NO_ERROR;
+}
 
-                ssize_t j = i-1;
-                void* next = reinterpret_cast<char*>(array) + mItemSize*(i);
-                do {
-                    _do_destroy(next, 1);
-                    _do_copy(next, curr, 1);
-                    next = curr;
-                    --j;
-                    curr = reinterpret_cast<char*>(array) + mItemSize*(j);
-                } while (j>=0 && (cmp(curr, temp, state) > 0));
+// ----------------------------------------------------------------------------
 
-                _do_destroy(next, 1);
-                _do_copy(next, temp, 1);
-            }
-            i++;
+template <typename KEY>
+static inline KEY radixKey(const char* item, KEY signBit)
+{
+    KEY key;
+    memcpy(&key, item, sizeof(KEY));
+    return key ^ signBit;
+}
+
+// count items of itemSize bytes, keyed by the KEY at keyOffset. Digits
+// every key agrees on are skipped; the result ends up back in array.
+template <typename KEY>
+static void radixSortItems(char* array, char* scratch, size_t count, size_t itemSize,
+        size_t keyOffset, bool isSigned)
+{
+    const KEY signBit = isSigned ? KEY(KEY(1) << (sizeof(KEY)*8 - 1)) : KEY(0);
+    size_t histogram[sizeof(KEY)][256];
+    memset(histogram, 0, sizeof(histogram));
+    const char* end = array + count*itemSize;
+    for (const char* item = array ; item != end ; item += itemSize) {
+        const KEY key = radixKey<KEY>(item + keyOffset, signBit);
+        for (size_t d = 0 ; d < sizeof(KEY) ; d++) {
+            histogram[d][(key >> (d*8)) & 0xff]++;
         }
+    }
 
-        if (temp) {
-            _do_destroy(temp, 1);
-            free(temp);
+    const KEY first = radixKey<KEY>(array + keyOffset, signBit);
+    char* from = array;
+    char* to = scratch;
+    for (size_t d = 0 ; d < sizeof(KEY) ; d++) {
+        size_t* offsets = histogram[d];
+        if (offsets[(first >> (d*8)) & 0xff] == count) {
+            continue;
+        }
+        size_t sum = 0;
+        for (size_t b = 0 ; b < 256 ; b++) {
+            const size_t n = offsets[b];
+            offsets[b] = sum;
+            sum += n;
+        }
+        end = from + count*itemSize;
+        for (const char* item = from ; item != end ; item += itemSize) {
+            const KEY key = radixKey<KEY>(item + keyOffset, signBit);
+            memcpy(to + offsets[(key >> (d*8)) & 0xff]++ * itemSize, item, itemSize);
         }
+        char* const swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != array) {
+        memcpy(array, from, count*itemSize);
+    }
+}
+
+status_t VectorImpl::radixSort(size_t keyOffset, size_t keyWidth, bool isSigned)
+{
+    if (!(mFlags & HAS_TRIVIAL_COPY)) {
+        return INVALID_OPERATION;
+    }
+    if (keyOffset > mItemSize || keyWidth > mItemSize - keyOffset ||
+            (keyWidth != 1 && keyWidth != 2 && keyWidth != 4 && keyWidth != 8)) {
+        return BAD_VALUE;
+    }
+    const size_t count = size();
+    VectorTraceScope trace(VectorTrace::SORT, count, mItemSize);
+    if (count < 2) {
+        return NO_ERROR;
+    }
+
+    VectorRealtime::check(VectorRealtime::SCRATCH, count, mItemSize);
+    void* scratch = malloc(count * mItemSize);
+    if (!scratch) return NO_MEMORY;
+    char* edited = reinterpret_cast<char*>(editArrayImpl());
+    if (!edited) {
+        free(scratch);
+        return NO_MEMORY;
+    }
+    char* buffer = reinterpret_cast<char*>(scratch);
+    switch (keyWidth) {
+        case 1:
+            radixSortItems<uint8_t>(edited, buffer, count, mItemSize, keyOffset, isSigned);
+            break;
+        case 2:
+            radixSortItems<uint16_t>(edited, buffer, count, mItemSize, keyOffset, isSigned);
+            break;
+        case 4:
+            radixSortItems<uint32_t>(edited, buffer, count, mItemSize, keyOffset, isSigned);
+            break;
+        case 8:
+            radixSortItems<uint64_t>(edited, buffer, count, mItemSize, keyOffset, isSigned);
+            break;
     }
+    free(scratch);
+    VectorTelemetry::record(VectorTelemetry::SORT, mItemSize, count * mItemSize, false);
     return NO_ERROR;
 }
 
@@ -275,6 +1127,67 @@ ssize_t VectorImpl::replaceAt(const void* prototype, size_t index)
     return ssize_t(index);
 }
 
+ssize_t VectorImpl::replaceArrayAt(const void* array, size_t index, size_t length)
+{
+    VectorSlackScope slack(this);
+    size_t end;
+    if (!safe_add(&end, index, length) || end > size()) {
+        return BAD_INDEX;
+    }
+    if (length == 0) {
+        return ssize_t(index);
+    }
+
+    const SharedBuffer* sb = SharedBuffer::bufferFromData(mStorage);
+    if (!sb->onlyOwner()) {
+        // the storage is shared: build the unique copy with the new items
+        // right away, instead of copying the range twice
+        VectorRealtime::check(VectorRealtime::COPY_ON_WRITE, capacity(), mItemSize);
+        SharedBuffer* editable = VectorPool::alloc(sb->size());
+        if (!editable) {
+            return NO_MEMORY;
+        }
+        uint8_t* to = reinterpret_cast<uint8_t *>(editable->data());
+        const uint8_t* from = reinterpret_cast<const uint8_t *>(mStorage);
+        _do_copy(to, from, index);
+        _do_copy(to + index*mItemSize, array, length);
+        _do_copy(to + end*mItemSize, from + end*mItemSize, mCount - end);
+        release_storage();
+        mStorage = editable->data();
+        VectorTelemetry::record(VectorTelemetry::EDIT, mItemSize, mCount * mItemSize,
+                true, editable->size() / mItemSize);
+        return ssize_t(index);
+    }
+
+    uint8_t* dest = reinterpret_cast<uint8_t *>(mStorage) + index*mItemSize;
+    const uint8_t* src = reinterpret_cast<const uint8_t *>(array);
+    const size_t bytes = length*mItemSize;
+    if (src < dest + bytes && dest < src + bytes) {
+        // the new items overlap the ones they replace
+        if (src == dest) {
+            return ssize_t(index);
+        }
+        if ((mFlags & HAS_TRIVIAL_COPY) && (mFlags & HAS_TRIVIAL_DTOR)) {
+            memmove(dest, src, bytes);
+            return ssize_t(index);
+        }
+        VectorRealtime::check(VectorRealtime::SCRATCH, length, mItemSize);
+        void* tmp = malloc(bytes);
+        if (!tmp) {
+            return NO_MEMORY;
+        }
+        _do_copy(tmp, src, length);
+        _do_destroy(dest, length);
+        _do_copy(dest, tmp, length);
+        _do_destroy(tmp, length);
+        free(tmp);
+        return ssize_t(index);
+    }
+    _do_destroy(dest, length);
+    _do_copy(dest, src, length);
+    return ssize_t(index);
+}
+
 ssize_t VectorImpl::removeItemsAt(size_t index, size_t count)
 {
     ALOG_ASSERT((index+count)<=size(),
@@ -287,8 +1200,245 @@ ssize_t VectorImpl::removeItemsAt(size_t index, size_t count)
    return index;
 }
 
+// a run of items that survives an editBatch(), moving from one index to another
+struct BatchSegment {
+    size_t  from;
+    size_t  to;
+    size_t  count;
+};
+
+ssize_t VectorImpl::editBatch(const Insertion* insertions, size_t numInsertions,
+                              const Removal* removals, size_t numRemovals)
+{
+    VectorSlackScope slack(this);
+    if (!numInsertions && !numRemovals) {
+        return ssize_t(mCount);
+    }
+
+    // check the lists, and work out the new size
+    size_t new_size = mCount;
+    size_t end = 0;
+    for (size_t r = 0 ; r < numRemovals ; r++) {
+        const Removal& removal = removals[r];
+        if (removal.index < end || !safe_add(&end, removal.index, removal.count) ||
+                end > mCount) {
+            return BAD_VALUE;
+        }
+        new_size -= removal.count;
+    }
+    size_t index = 0;
+    for (size_t k = 0 ; k < numInsertions ; k++) {
+        const Insertion& insertion = insertions[k];
+        if (insertion.index < index || insertion.index > mCount ||
+                !safe_add(&new_size, new_size, insertion.count)) {
+            return BAD_VALUE;
+        }
+        index = insertion.index;
+    }
+
+    VectorTraceScope trace(VectorTrace::EDIT_BATCH, new_size, mItemSize);
+
+    // the runs of surviving items, and where each insertion goes
+    const size_t maxSegments = numInsertions + numRemovals + 1;
+    VectorRealtime::check(VectorRealtime::SCRATCH, 1,
+            maxSegments*sizeof(BatchSegment) + numInsertions*sizeof(size_t));
+    BatchSegment* segments = reinterpret_cast<BatchSegment*>(
+            malloc(maxSegments*sizeof(BatchSegment) + numInsertions*sizeof(size_t)));
+    if (!segments) {
+        return NO_MEMORY;
+    }
+    size_t* slots = reinterpret_cast<size_t*>(segments + maxSegments);
+    size_t numSegments = 0;
+    size_t from = 0;
+    size_t to = 0;
+    size_t r = 0;
+    size_t k = 0;
+    for (;;) {
+        size_t next = mCount;
+        if (r < numRemovals && removals[r].index < next) next = removals[r].index;
+        if (k < numInsertions && insertions[k].index < next) next = insertions[k].index;
+        if (next > from) {
+            BatchSegment& segment = segments[numSegments++];
+            segment.from = from;
+            segment.to = to;
+            segment.count = next - from;
+            to += next - from;
+            from = next;
+        }
+        while (k < numInsertions && insertions[k].index <= from) {
+            slots[k] = to;
+            to += insertions[k].count;
+            k++;
+        }
+        if (r < numRemovals && removals[r].index == from) {
+            from += removals[r].count;
+            r++;
+        } else if (from == mCount) {
+            break;
+        }
+    }
+    ALOG_ASSERT(to == new_size, "[%p] editBatch: planned %d items for %d",
+            this, (int)to, (int)new_size);
+
+    const size_t old_capacity = capacity();
+    size_t new_capacity = old_capacity;
+    if (new_size > old_capacity) {
+        new_capacity = VectorPolicy::grownCapacity(new_size);
+        LOG_ALWAYS_FATAL_IF(!new_capacity, "new_capacity overflow");
+        new_capacity = max(kMinVectorCapacity, new_capacity);
+    } else if (VectorPolicy::shouldShrink(new_size, old_capacity)) {
+        // NOTE: (new_size * 2) is safe, see _shrink()
+        new_capacity = max(kMinVectorCapacity, new_size * 2);
+        // never below what reserve() asked for
+        new_capacity = max(new_capacity, VectorRealtime::reservedCapacity(this));
+        if (new_capacity > old_capacity) {
+            new_capacity = old_capacity;
+        }
+    }
+
+    uint8_t* array;
+    size_t moved = 0;   // items moved or copied, for the telemetry
+    const bool inPlace = new_capacity == old_capacity && mStorage &&
+            SharedBuffer::bufferFromData(mStorage)->onlyOwner();
+    if (inPlace) {
+        // in place: drop the removed items, then move the survivors going
+        // down front to back and the ones going up back to front, so that
+        // no run lands on one that hasn't moved yet
+        array = reinterpret_cast<uint8_t *>(mStorage);
+        for (r = 0 ; r < numRemovals ; r++) {
+            _do_destroy(array + removals[r].index*mItemSize, removals[r].count);
+        }
+        for (size_t i = 0 ; i < numSegments ; i++) {
+            const BatchSegment& segment = segments[i];
+            if (segment.to < segment.from) {
+                _do_move_backward(array + segment.to*mItemSize,
+                        array + segment.from*mItemSize, segment.count);
+                moved += segment.count;
+            }
+        }
+        for (size_t i = numSegments ; i-- > 0 ; ) {
+            const BatchSegment& segment = segments[i];
+            if (segment.to > segment.from) {
+                _do_move_forward(array + segment.to*mItemSize,
+                        array + segment.from*mItemSize, segment.count);
+                moved += segment.count;
+            }
+        }
+    } else {
+        // the storage is shared or has the wrong size: build the new one in
+        // a single copy
+        size_t new_alloc_size = 0;
+        LOG_ALWAYS_FATAL_IF(!safe_mul(&new_alloc_size, new_capacity, mItemSize),
+                            "new_alloc_size overflow");
+        VectorRealtime::check(VectorRealtime::GROW, new_capacity, mItemSize);
+        SharedBuffer* sb = VectorPool::alloc(new_alloc_size);
+        if (!sb) {
+            free(segments);
+            return NO_MEMORY;
+        }
+        array = reinterpret_cast<uint8_t *>(sb->data());
+        const uint8_t* old = reinterpret_cast<const uint8_t *>(mStorage);
+        for (size_t i = 0 ; i < numSegments ; i++) {
+            const BatchSegment& segment = segments[i];
+            _do_copy(array + segment.to*mItemSize, old + segment.from*mItemSize, segment.count);
+            moved += segment.count;
+        }
+        release_storage();
+        mStorage = array;
+        if (new_capacity > old_capacity) {
+            VectorPolicy::count(VectorPolicy::GROW);
+        } else if (new_capacity < old_capacity) {
+            VectorPolicy::count(VectorPolicy::SHRINK);
+        }
+    }
+
+    for (k = 0 ; k < numInsertions ; k++) {
+        const Insertion& insertion = insertions[k];
+        void* dest = array + slots[k]*mItemSize;
+        if (insertion.items) {
+            _do_copy(dest, insertion.items, insertion.count);
+        } else {
+            _do_construct(dest, insertion.count);
+        }
+        moved += insertion.count;
+    }
+    mCount = new_size;
+    free(segments);
+    VectorTelemetry::record(VectorTelemetry::EDIT_BATCH, mItemSize, moved * mItemSize,
+            !inPlace, new_capacity);
+    return ssize_t(new_size);
+}
+
+ssize_t VectorImpl::removeItemsIf(predicate_r_t pred, void* state)
+{
+    VectorSlackScope slack(this);
+    // look for the first victim without making the storage unique
+    const size_t count = mCount;
+    const uint8_t* items = reinterpret_cast<const uint8_t *>(mStorage);
+    size_t first = 0;
+    while (first < count && !pred(items + first*mItemSize, state)) {
+        first++;
+    }
+    if (first == count) {
+        return 0;
+    }
+
+    size_t kept = first;
+    const SharedBuffer* sb = SharedBuffer::bufferFromData(mStorage);
+    if (!sb->onlyOwner()) {
+        // shared: only copy the survivors to the unique storage, which is
+        // then sized for the old count already
+        VectorRealtime::check(VectorRealtime::COPY_ON_WRITE, count, mItemSize);
+        SharedBuffer* editable = VectorPool::alloc(count * mItemSize);
+        if (!editable) {
+            return NO_MEMORY;
+        }
+        uint8_t* array = reinterpret_cast<uint8_t *>(editable->data());
+        _do_copy(array, items, first);
+        for (size_t i = first + 1 ; i < count ; i++) {
+            const uint8_t* item = items + i*mItemSize;
+            if (!pred(item, state)) {
+                _do_copy(array + kept*mItemSize, item, 1);
+                kept++;
+            }
+        }
+        release_storage();
+        mStorage = array;
+        mCount = kept;
+        VectorTelemetry::record(VectorTelemetry::EDIT, mItemSize, kept * mItemSize,
+                true, count);
+        return ssize_t(count - kept);
+    }
+
+    // unique: destroy the victims where they are and move each run of
+    // survivors down in one go
+    uint8_t* array = reinterpret_cast<uint8_t *>(mStorage);
+    _do_destroy(array + first*mItemSize, 1);
+    size_t i = first + 1;
+    while (i < count) {
+        const size_t run = i;
+        while (i < count && !pred(array + i*mItemSize, state)) {
+            i++;
+        }
+        if (i != run) {
+            _do_move_backward(array + kept*mItemSize, array + run*mItemSize, i - run);
+            kept += i - run;
+        }
+        if (i < count) {
+            _do_destroy(array + i*mItemSize, 1);
+            i++;
+        }
+    }
+    mCount = kept;
+
+    // give memory back, with at most one reallocation
+    _shrink(kept, 0);
+    return ssize_t(count - kept);
+}
+
 void VectorImpl::finish_vector()
 {
+    VectorSlackScope slack(this);
     release_storage();
     mStorage = 0;
     mCount = 0;
@@ -314,6 +1464,19 @@ void* VectorImpl::editItemLocation(size_t index)
     return 0;
 }
 
+void* VectorImpl::editItemRange(size_t index, size_t count)
+{
+    size_t end;
+    if (!safe_add(&end, index, count) || end > size()) {
+        return 0;
+    }
+    void* buffer = editArrayImpl();
+    if (buffer) {
+        return reinterpret_cast<char*>(buffer) + index*mItemSize;
+    }
+    return 0;
+}
+
 const void* VectorImpl::itemLocation(size_t index) const
 {
     ALOG_ASSERT(index<capacity(),
@@ -331,6 +1494,7 @@ const void* VectorImpl::itemLocation(size_t index) const
 
 ssize_t VectorImpl::setCapacity(size_t new_capacity)
 {
+    VectorSlackScope slack(this);
     // The capacity must always be greater than or equal to the size
     // of this vector.
     if (new_capacity <= size()) {
@@ -339,18 +1503,55 @@ ssize_t VectorImpl::setCapacity(size_t new_capacity)
 
     size_t new_allocation_size = 0;
     LOG_ALWAYS_FATAL_IF(!safe_mul(&new_allocation_size, new_capacity, mItemSize));
-    SharedBuffer* sb = SharedBuffer::alloc(new_allocation_size);
+    VectorRealtime::check(VectorRealtime::SET_CAPACITY, new_capacity, mItemSize);
+    SharedBuffer* sb;
+    if (mStorage && _relocatable()) {
+        // realloc() may not even have to move them
+        sb = VectorPool::editResize(SharedBuffer::bufferFromData(mStorage),
+                new_allocation_size);
+        if (sb) {
+            mStorage = sb->data();
+        }
+    } else {
+        sb = VectorPool::alloc(new_allocation_size);
+        if (sb) {
+            void* array = sb->data();
+            _do_copy(array, mStorage, size());
+            release_storage();
+            mStorage = const_cast<void*>(array);
+        }
+    }
     if (sb) {
-        void* array = sb->data();
-        _do_copy(array, mStorage, size());
-        release_storage();
-        mStorage = const_cast<void*>(array);
+        VectorPolicy::count(VectorPolicy::SET_CAPACITY);
+        VectorTelemetry::record(VectorTelemetry::SET_CAPACITY, mItemSize,
+                size() * mItemSize, true, new_capacity);
     } else {
         return NO_MEMORY;
     }
     return new_capacity;
 }
 
+ssize_t VectorImpl::reserve(size_t size)
+{
+    VectorSlackScope slack(this);
+    if (!size) {
+        VectorRealtime::setReserved(this, 0);
+        return capacity();
+    }
+    if (size > capacity()) {
+        const ssize_t err = setCapacity(size);
+        if (err < 0) {
+            return err;
+        }
+    }
+    if (mStorage) {
+        // or the first edit would copy it
+        editArrayImpl();
+    }
+    const status_t err = VectorRealtime::setReserved(this, size);
+    return err ? ssize_t(err) : ssize_t(capacity());
+}
+
 ssize_t VectorImpl::resize(size_t size) {
     ssize_t result = NO_ERROR;
     if (size > mCount) {
@@ -364,16 +1565,66 @@ ssize_t VectorImpl::resize(size_t size) {
 void VectorImpl::release_storage()
 {
     if (mStorage) {
-        const SharedBuffer* sb = SharedBuffer::bufferFromData(mStorage);
-        if (sb->release(SharedBuffer::eKeepStorage) == 1) {
-            _do_destroy(mStorage, mCount);
-            SharedBuffer::dealloc(sb);
-        }
+        _release_storage(mStorage, mCount);
+    }
+}
+
+void VectorImpl::_release_storage(void* storage, size_t count) const
+{
+    const SharedBuffer* sb = SharedBuffer::bufferFromData(storage);
+    if (sb->release(SharedBuffer::eKeepStorage) == 1) {
+        VectorSlack::forget(storage);
+        _free_storage(storage, count);
+    }
+}
+
+void VectorImpl::_free_storage(void* storage, size_t count) const
+{
+    const SharedBuffer* sb = SharedBuffer::bufferFromData(storage);
+    _do_destroy(storage, count);
+    if (count && !(mFlags & HAS_TRIVIAL_DTOR)) {
+        // destroying the items already cost this thread more than the
+        // free() would, see NV_VectorReclaimer.h
+        VectorPool::dealloc(sb);
+    } else {
+        VectorReclaimer::dealloc(sb);
+    }
+}
+
+void VectorImpl::_forgetStaleReservation() const
+{
+    // left at this address by a reserved vector that was moved away with
+    // memcpy(), see reserve()
+    if (VectorRealtime::reservedCapacity(this)) {
+        VectorRealtime::setReserved(this, 0);
+    }
+}
+
+bool VectorImpl::_relocatable() const
+{
+    if ((mFlags & HAS_TRIVIAL_COPY) && (mFlags & HAS_TRIVIAL_DTOR)) {
+        // copying them is as good as moving, even out of shared storage
+        return true;
+    }
+    // the others can only be moved out of storage nobody else holds
+    return (mFlags & HAS_TRIVIAL_MOVE) && mStorage &&
+            SharedBuffer::bufferFromData(mStorage)->onlyOwner();
+}
+
+void VectorImpl::_release_relocated()
+{
+    // like release_storage(), but the items now live elsewhere: there's
+    // nothing left to destroy
+    const SharedBuffer* sb = SharedBuffer::bufferFromData(mStorage);
+    if (sb->release(SharedBuffer::eKeepStorage) == 1) {
+        VectorSlack::forget(mStorage);
+        VectorReclaimer::dealloc(sb);
     }
 }
 
 void* VectorImpl::_grow(size_t where, size_t amount)
 {
+    VectorSlackScope slack(this);
 //    ALOGV("_grow(this=%p, where=%d, amount=%d) count=%d, capacity=%d",
 //        this, (int)where, (int)amount, (int)mCount, (int)capacity());
 
@@ -381,6 +1632,8 @@ void* VectorImpl::_grow(size_t where, size_t amount)
             "[%p] _grow: where=%d, amount=%d, count=%d",
             this, (int)where, (int)amount, (int)mCount); // caller already checked
 
+    VectorTraceScope trace(VectorTrace::GROW, mCount + amount, mItemSize);
+
     size_t new_size;
     LOG_ALWAYS_FATAL_IF(!safe_add(&new_size, mCount, amount), "new_size overflow");
 
@@ -391,12 +1644,10 @@ void* VectorImpl::_grow(size_t where, size_t amount)
         // capacity without the +1. The old calculation wouldn't work properly
         // if x was zero.
         //
-        // This approximates the old calculation, using (x + (x/2) + 1) instead.
-        size_t new_capacity = 0;
-        LOG_ALWAYS_FATAL_IF(!safe_add(&new_capacity, new_size, (new_size / 2)),
-                            "new_capacity overflow");
-        LOG_ALWAYS_FATAL_IF(!safe_add(&new_capacity, new_capacity, static_cast<size_t>(1u)),
-                            "new_capacity overflow");
+        // The default policy approximates the old calculation, using
+        // (x + (x/2) + 1) instead.
+        size_t new_capacity = VectorPolicy::grownCapacity(new_size);
+        LOG_ALWAYS_FATAL_IF(!new_capacity, "new_capacity overflow");
         new_capacity = max(kMinVectorCapacity, new_capacity);
 
         size_t new_alloc_size = 0;
@@ -404,32 +1655,42 @@ void* VectorImpl::_grow(size_t where, size_t amount)
                             "new_alloc_size overflow");
 
 //        ALOGV("grow vector %p, new_capacity=%d", this, (int)new_capacity);
-        if ((mStorage) &&
-            (mCount==where) &&
-            (mFlags & HAS_TRIVIAL_COPY) &&
-            (mFlags & HAS_TRIVIAL_DTOR))
-        {
+        VectorRealtime::check(VectorRealtime::GROW, new_capacity, mItemSize);
+        const bool relocate = mStorage && _relocatable();
+        if (relocate && mCount == where) {
             const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
-            SharedBuffer* sb = cur_sb->editResize(new_alloc_size);
+            SharedBuffer* sb = VectorPool::editResize(cur_sb, new_alloc_size);
             if (sb) {
                 mStorage = sb->data();
+                VectorPolicy::count(VectorPolicy::GROW_IN_PLACE);
+                VectorTelemetry::record(VectorTelemetry::GROW, mItemSize,
+                        mCount * mItemSize, true, new_capacity);
             } else {
                 return NULL;
             }
         } else {
-            SharedBuffer* sb = SharedBuffer::alloc(new_alloc_size);
+            SharedBuffer* sb = VectorPool::alloc(new_alloc_size);
             if (sb) {
                 void* array = sb->data();
-                if (where != 0) {
-                    _do_copy(array, mStorage, where);
-                }
-                if (where != mCount) {
-                    const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
-                    void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
-                    _do_copy(dest, from, mCount-where);
+                const void* tail = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
+                void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
+                if (relocate) {
+                    memcpy(array, mStorage, where*mItemSize);
+                    memcpy(dest, tail, (mCount-where)*mItemSize);
+                    _release_relocated();
+                } else {
+                    if (where != 0) {
+                        _do_copy(array, mStorage, where);
+                    }
+                    if (where != mCount) {
+                        _do_copy(dest, tail, mCount-where);
+                    }
+                    release_storage();
                 }
-                release_storage();
                 mStorage = const_cast<void*>(array);
+                VectorPolicy::count(VectorPolicy::GROW);
+                VectorTelemetry::record(VectorTelemetry::GROW, mItemSize,
+                        mCount * mItemSize, true, new_capacity);
             } else {
                 return NULL;
             }
@@ -441,6 +1702,8 @@ void* VectorImpl::_grow(size_t where, size_t amount)
             void* to = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
             _do_move_forward(to, from, mCount - where);
         }
+        VectorTelemetry::record(VectorTelemetry::GROW, mItemSize,
+                (mCount - where) * mItemSize, false);
     }
     mCount = new_size;
     void* free_space = const_cast<void*>(itemLocation(where));
@@ -449,6 +1712,7 @@ void* VectorImpl::_grow(size_t where, size_t amount)
 
 void VectorImpl::_shrink(size_t where, size_t amount)
 {
+    VectorSlackScope slack(this);
     if (!mStorage)
         return;
 
@@ -462,41 +1726,64 @@ void VectorImpl::_shrink(size_t where, size_t amount)
     size_t new_size;
     LOG_ALWAYS_FATAL_IF(!safe_sub(&new_size, mCount, amount));
 
-    if (new_size < (capacity() / 2)) {
-        // NOTE: (new_size * 2) is safe because capacity didn't overflow and
-        // new_size < (capacity / 2)).
-        const size_t new_capacity = max(kMinVectorCapacity, new_size * 2);
+    const size_t old_capacity = capacity();
+    // NOTE: (new_size * 2) is safe because capacity didn't overflow and
+    // shouldShrink() only holds for new_size < (capacity / 2).
+    size_t new_capacity = 0;
+    if (VectorPolicy::shouldShrink(new_size, old_capacity)) {
+        new_capacity = max(kMinVectorCapacity, new_size * 2);
+        // never below what reserve() asked for
+        new_capacity = max(new_capacity, VectorRealtime::reservedCapacity(this));
+    }
 
+    // a minimum-sized vector has nothing to give back
+    if (new_capacity && new_capacity < old_capacity) {
         // NOTE: (new_capacity * mItemSize), (where * mItemSize) and
         // ((where + amount) * mItemSize) beyond this point are safe because
         // we are always reducing the capacity of the underlying SharedBuffer.
         // In other words, (old_capacity * mItemSize) did not overflow, and
         // where < (where + amount) < new_capacity < old_capacity.
-        if ((where == new_size) &&
-            (mFlags & HAS_TRIVIAL_COPY) &&
-            (mFlags & HAS_TRIVIAL_DTOR))
-        {
-            const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
-            SharedBuffer* sb = cur_sb->editResize(new_capacity * mItemSize);
+        VectorRealtime::check(VectorRealtime::SHRINK, new_capacity, mItemSize);
+
+        // a block big enough for the reclaimer is swapped for a new one
+        // rather than shrunk, so it can be freed off this thread
+        const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
+        const bool relocate = _relocatable();
+        if (relocate && where == new_size && !VectorReclaimer::wants(cur_sb->size())) {
+            // the removed items are the last ones: they go with the tail
+            // of the block, unless the resize fails and the block stays
+            _do_destroy(reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize, amount);
+            SharedBuffer* sb = VectorPool::editResize(cur_sb, new_capacity * mItemSize);
             if (sb) {
                 mStorage = sb->data();
-            } else {
-                return;
+                VectorPolicy::count(VectorPolicy::SHRINK_IN_PLACE);
+                VectorTelemetry::record(VectorTelemetry::SHRINK, mItemSize,
+                        new_size * mItemSize, true, new_capacity);
             }
         } else {
-            SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
+            SharedBuffer* sb = VectorPool::alloc(new_capacity * mItemSize);
             if (sb) {
                 void* array = sb->data();
-                if (where != 0) {
-                    _do_copy(array, mStorage, where);
-                }
-                if (where != new_size) {
-                    const void* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+amount)*mItemSize;
-                    void* dest = reinterpret_cast<uint8_t *>(array) + where*mItemSize;
-                    _do_copy(dest, from, new_size - where);
+                const void* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                void* dest = reinterpret_cast<uint8_t *>(array) + where*mItemSize;
+                if (relocate) {
+                    _do_destroy(reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize, amount);
+                    memcpy(array, mStorage, where*mItemSize);
+                    memcpy(dest, from, (new_size - where)*mItemSize);
+                    _release_relocated();
+                } else {
+                    if (where != 0) {
+                        _do_copy(array, mStorage, where);
+                    }
+                    if (where != new_size) {
+                        _do_copy(dest, from, new_size - where);
+                    }
+                    release_storage();
                 }
-                release_storage();
                 mStorage = const_cast<void*>(array);
+                VectorPolicy::count(VectorPolicy::SHRINK);
+                VectorTelemetry::record(VectorTelemetry::SHRINK, mItemSize,
+                        new_size * mItemSize, true, new_capacity);
             } else{
                 return;
             }
@@ -509,6 +1796,8 @@ void VectorImpl::_shrink(size_t where, size_t amount)
             const void* from = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
             _do_move_backward(to, from, new_size - where);
         }
+        VectorTelemetry::record(VectorTelemetry::SHRINK, mItemSize,
+                (new_size - where) * mItemSize, false);
     }
     mCount = new_size;
 }
@@ -536,20 +1825,41 @@ void VectorImpl::_do_copy(void* dest, const void* from, size_t num) const
     if (!(mFlags & HAS_TRIVIAL_COPY)) {
         do_copy(dest, from, num);
     } else {
-        memcpy(dest, from, num*itemSize());
+        vectorCopy(dest, from, num, mItemSize);
     }
 }
 
 void VectorImpl::_do_splat(void* dest, const void* item, size_t num) const {
-    do_splat(dest, item, num);
+    if (!(mFlags & HAS_TRIVIAL_COPY) || !vectorKernelItemSize(mItemSize)) {
+        do_splat(dest, item, num);
+    } else {
+        vectorSplat(dest, item, num, mItemSize);
+    }
 }
 
 void VectorImpl::_do_move_forward(void* dest, const void* from, size_t num) const {
-    do_move_forward(dest, from, num);
+    if (!hasTrivialMove(mFlags)) {
+        do_move_forward(dest, from, num);
+    } else {
+        vectorMove(dest, from, num, mItemSize);
+    }
 }
 
 void VectorImpl::_do_move_backward(void* dest, const void* from, size_t num) const {
-    do_move_backward(dest, from, num);
+    if (!hasTrivialMove(mFlags)) {
+        do_move_backward(dest, from, num);
+    } else {
+        vectorMove(dest, from, num, mItemSize);
+    }
+}
+
+void VectorImpl::_do_relocate(void* dest, void* from, size_t num) const {
+    if (!hasTrivialMove(mFlags)) {
+        do_copy(dest, from, num);
+        _do_destroy(from, num);
+    } else {
+        vectorCopy(dest, from, num, mItemSize);
+    }
 }
 
 void VectorImpl::reservedVectorImpl1() { }
@@ -573,6 +1883,16 @@ SortedVectorImpl::SortedVectorImpl(const VectorImpl& rhs)
 {
 }
 
+SortedVectorImpl::SortedVectorImpl(const SortedVectorImpl& rhs)
+: VectorImpl(rhs)
+{
+}
+
+SortedVectorImpl::SortedVectorImpl(SortedVectorImpl&& rhs)
+: VectorImpl(static_cast<VectorImpl&&>(rhs))
+{
+}
+
 SortedVectorImpl::~SortedVectorImpl()
 {
 }
@@ -582,6 +1902,11 @@ SortedVectorImpl& SortedVectorImpl::operator = (const SortedVectorImpl& rhs)
     return static_cast<SortedVectorImpl&>( VectorImpl::operator = (static_cast<const VectorImpl&>(rhs)) );
 }
 
+SortedVectorImpl& SortedVectorImpl::operator = (SortedVectorImpl&& rhs)
+{
+    return static_cast<SortedVectorImpl&>( VectorImpl::operator = (static_cast<VectorImpl&&>(rhs)) );
+}
+
 ssize_t SortedVectorImpl::indexOf(const void* item) const
 {
     return _indexOrderOf(item);
@@ -595,11 +1920,17 @@ size_t SortedVectorImpl::orderOf(const void* item) const
 }
 
 ssize_t SortedVectorImpl::_indexOrderOf(const void* item, size_t* order) const
+{
+    return _indexOrderOfRange(item, order, 0, size());
+}
+
+ssize_t SortedVectorImpl::_indexOrderOfRange(const void* item, size_t* order,
+        size_t lo, size_t hi) const
 {
     // binary search
     ssize_t err = NAME_NOT_FOUND;
-    ssize_t l = 0;
-    ssize_t h = size()-1;
+    ssize_t l = lo;
+    ssize_t h = hi-1;
     ssize_t mid;
     const void* a = arrayImpl();
     const size_t s = itemSize();
@@ -620,8 +1951,85 @@ ssize_t SortedVectorImpl::_indexOrderOf(const void* item, size_t* order) const
     return err;
 }
 
+ssize_t SortedVectorImpl::_indexOrderOfNear(const void* item, size_t* order,
+        size_t hint) const
+{
+    const size_t n = size();
+    if (hint >= n) {
+        if (!n) {
+            *order = 0;
+            return NAME_NOT_FOUND;
+        }
+        hint = n - 1;
+    }
+    const char* a = reinterpret_cast<const char *>(arrayImpl());
+    const size_t s = itemSize();
+    int c = do_compare(a + hint*s, item);
+    if (c == 0) {
+        *order = hint;
+        return hint;
+    }
+
+    // gallop away from the hint until the item is bracketed, then
+    // binary search the bracket
+    size_t lo = 0;
+    size_t hi = n;
+    if (c < 0) {
+        lo = hint + 1;
+        for (size_t step = 1 ; step < n - hint ; step <<= 1) {
+            const size_t probe = hint + step;
+            c = do_compare(a + probe*s, item);
+            if (c == 0) {
+                *order = probe;
+                return probe;
+            }
+            if (c > 0) {
+                hi = probe;
+                break;
+            }
+            lo = probe + 1;
+        }
+    } else {
+        hi = hint;
+        for (size_t step = 1 ; step <= hint ; step <<= 1) {
+            const size_t probe = hint - step;
+            c = do_compare(a + probe*s, item);
+            if (c == 0) {
+                *order = probe;
+                return probe;
+            }
+            if (c < 0) {
+                lo = probe + 1;
+                break;
+            }
+            hi = probe;
+        }
+    }
+    return _indexOrderOfRange(item, order, lo, hi);
+}
+
+void SortedVectorImpl::indexOfBatch(const void* items, size_t count,
+        ssize_t* indices, size_t* orders) const
+{
+    _lookupBatch(items, itemSize(), count, indices, orders,
+            [this](const void* lhs, const void* rhs) { return do_compare(lhs, rhs); });
+}
+
 ssize_t SortedVectorImpl::add(const void* item)
 {
+    // tables are often built from sorted data: try appending first
+    const size_t n = size();
+    if (n) {
+        const void* last = reinterpret_cast<const char *>(arrayImpl()) + (n - 1)*itemSize();
+        const int c = do_compare(last, item);
+        if (c < 0) {
+            return VectorImpl::insertAt(item, n, 1);
+        }
+        if (c == 0) {
+            return VectorImpl::replaceAt(item, n - 1);
+        }
+    }
+
     size_t order;
     ssize_t index = _indexOrderOf(item, &order);
     if (index < 0) {
@@ -632,41 +2040,239 @@ ssize_t SortedVectorImpl::add(const void* item)
     return index;
 }
 
+ssize_t SortedVectorImpl::add(const void* item, size_t hint)
+{
+    size_t order;
+    ssize_t index = _indexOrderOfNear(item, &order, hint);
+    if (index < 0) {
+        index = VectorImpl::insertAt(item, order, 1);
+    } else {
+        index = VectorImpl::replaceAt(item, index);
+    }
+    return index;
+}
+
 ssize_t SortedVectorImpl::merge(const VectorImpl& vector)
 {
-    // naive merge...
-    if (!vector.isEmpty()) {
-        const void* buffer = vector.arrayImpl();
-        const size_t is = itemSize();
-        size_t s = vector.size();
-        for (size_t i=0 ; i<s ; i++) {
-            ssize_t err = add( reinterpret_cast<const char*>(buffer) + i*is );
-            if (err<0) {
-                return err;
+    VectorSlackScope slack(this);
+    const size_t length = vector.size();
+    VectorTraceScope trace(VectorTrace::MERGE, size() + length, itemSize());
+    if (length == 0) {
+        return NO_ERROR;
+    }
+    if (length == 1) {
+        ssize_t err = add(vector.arrayImpl());
+        return err < 0 ? err : (ssize_t)NO_ERROR;
+    }
+
+    // bulk path: sort a private copy of the incoming items, drop duplicate
+    // keys (the last one wins, as if they had been add()ed in order) and
+    // merge the result with our items in one pass.
+    const size_t s = itemSize();
+    size_t alloc_size = 0;
+    LOG_ALWAYS_FATAL_IF(!safe_mul(&alloc_size, length, s), "alloc_size overflow");
+    VectorRealtime::check(VectorRealtime::SCRATCH, length, s);
+    SharedBuffer* sb = VectorPool::alloc(alloc_size);
+    if (!sb) {
+        return NO_MEMORY;
+    }
+    void* scratch = malloc(VectorImplSorter::scratchItems(length) * s);
+    if (!scratch) {
+        VectorPool::dealloc(sb);
+        return NO_MEMORY;
+    }
+
+    char* const items = reinterpret_cast<char*>(sb->data());
+    _do_copy(items, vector.arrayImpl(), length);
+    VectorImplSorter(*this, compareProxy, this, scratch).sort(items, length);
+    free(scratch);
+
+    size_t count = 0;
+    for (size_t i = 0 ; i < length ; i++) {
+        char* const item = items + i*s;
+        if (i+1 < length && do_compare(item, item + s) == 0) {
+            _do_destroy(item, 1);
+        } else {
+            if (count != i) {
+                _do_copy(items + count*s, item, 1);
+                _do_destroy(item, 1);
             }
+            count++;
         }
     }
-    return NO_ERROR;
+
+    ssize_t err = NO_ERROR;
+    if (isEmpty() && !VectorRealtime::reservedCapacity(this)) {
+        // nothing to merge with, the sorted copy becomes our storage
+        release_storage();
+        mStorage = items;
+        mCount = count;
+    } else {
+        err = _merge(items, count);
+        _free_storage(items, count);
+    }
+    return err;
 }
 
 ssize_t SortedVectorImpl::merge(const SortedVectorImpl& vector)
 {
+    VectorTraceScope trace(VectorTrace::MERGE, size() + vector.size(), itemSize());
+
     // we've merging a sorted vector... nice!
     ssize_t err = NO_ERROR;
     if (!vector.isEmpty()) {
+        if (vector.arrayImpl() == arrayImpl() && vector.size() == size()) {
+            // same storage: every item would just replace itself
+            return NO_ERROR;
+        }
         // first take care of the case where the vectors are sorted together
-        if (do_compare(vector.itemLocation(vector.size()-1), arrayImpl()) <= 0) {
+        if (isEmpty() || do_compare(vector.itemLocation(vector.size()-1), arrayImpl()) < 0) {
             err = VectorImpl::insertVectorAt(static_cast<const VectorImpl&>(vector), 0);
-        } else if (do_compare(vector.arrayImpl(), itemLocation(size()-1)) >= 0) {
+        } else if (do_compare(vector.arrayImpl(), itemLocation(size()-1)) > 0) {
             err = VectorImpl::appendVector(static_cast<const VectorImpl&>(vector));
         } else {
-            // this could be made a little better
-            err = merge(static_cast<const VectorImpl&>(vector));
+            err = _merge(vector.arrayImpl(), vector.size());
         }
     }
     return err;
 }
 
+ssize_t SortedVectorImpl::_merge(const void* array, size_t length)
+{
+    VectorSlackScope slack(this);
+    // linear merge of two sorted arrays. On equal keys the incoming item
+    // replaces ours, just like add() would do.
+    const size_t s = itemSize();
+    const size_t lcount = size();
+    const size_t rcount = length;
+    size_t new_size = 0;
+    LOG_ALWAYS_FATAL_IF(!safe_add(&new_size, lcount, rcount), "new_size overflow");
+    if (mStorage && SharedBuffer::bufferFromData(mStorage)->onlyOwner() &&
+            capacity() >= new_size) {
+        _mergeInPlace(array, length);
+        return NO_ERROR;
+    }
+
+    // never below what reserve() asked for
+    const size_t new_capacity = max(new_size, VectorRealtime::reservedCapacity(this));
+    size_t new_alloc_size = 0;
+    LOG_ALWAYS_FATAL_IF(!safe_mul(&new_alloc_size, new_capacity, s), "new_alloc_size overflow");
+    VectorRealtime::check(VectorRealtime::GROW, new_capacity, s);
+    SharedBuffer* sb = VectorPool::alloc(new_alloc_size);
+    if (!sb) {
+        return NO_MEMORY;
+    }
+
+    const char* lhs = reinterpret_cast<const char*>(arrayImpl());
+    const char* rhs = reinterpret_cast<const char*>(array);
+    char* const base = reinterpret_cast<char*>(sb->data());
+    char* dest = base;
+    size_t l = 0;
+    size_t r = 0;
+    while (l < lcount && r < rcount) {
+        // our items that sort before the next incoming one
+        size_t start = l;
+        int c = -1;
+        while (l < lcount && (c = do_compare(lhs + l*s, rhs + r*s)) < 0) {
+            l++;
+        }
+        _do_copy(dest, lhs + start*s, l - start);
+        dest += (l - start)*s;
+        if (l == lcount)
+            break;
+        if (c == 0)
+            l++;    // replaced by the incoming item
+
+        // incoming items that sort before (or replace) our next one
+        start = r++;
+        while (r < rcount && l < lcount && (c = do_compare(rhs + r*s, lhs + l*s)) <= 0) {
+            if (c == 0)
+                l++;
+            r++;
+        }
+        _do_copy(dest, rhs + start*s, r - start);
+        dest += (r - start)*s;
+    }
+    if (l < lcount) {
+        _do_copy(dest, lhs + l*s, lcount - l);
+        dest += (lcount - l)*s;
+    }
+    if (r < rcount) {
+        _do_copy(dest, rhs + r*s, rcount - r);
+        dest += (rcount - r)*s;
+    }
+
+    release_storage();
+    mStorage = base;
+    mCount = (dest - base) / s;
+    return NO_ERROR;
+}
+
+void SortedVectorImpl::_mergeInPlace(const void* array, size_t length)
+{
+    // the same merge, from the back and into the free space after our
+    // items: a slot is only written once the item it held has moved on.
+    // Replaced items leave a gap, closed at the end.
+    const size_t s = itemSize();
+    char* const base = reinterpret_cast<char*>(mStorage);
+    const char* rhs = reinterpret_cast<const char*>(array);
+    size_t l = mCount;
+    size_t r = length;
+    size_t d = mCount + length;
+    while (l > 0 && r > 0) {
+        // our items that sort after the last incoming one
+        size_t end = l;
+        int c = 1;
+        while (l > 0 && (c = do_compare(base + (l-1)*s, rhs + (r-1)*s)) > 0) {
+            l--;
+        }
+        if (end != l) {
+            d -= end - l;
+            _do_move_forward(base + d*s, base + l*s, end - l);
+        }
+        if (l == 0)
+            break;
+        if (c == 0)
+            _do_destroy(base + (--l)*s, 1);     // replaced by the incoming item
+
+        // incoming items that sort after (or replace) our last one
+        end = r--;
+        while (r > 0 && l > 0 && (c = do_compare(rhs + (r-1)*s, base + (l-1)*s)) >= 0) {
+            if (c == 0)
+                _do_destroy(base + (--l)*s, 1);
+            r--;
+        }
+        d -= end - r;
+        _do_copy(base + d*s, rhs + r*s, end - r);
+    }
+    if (r > 0) {
+        d -= r;
+        _do_copy(base + d*s, rhs, r);
+    }
+    const size_t new_size = mCount + length - (d - l);
+    if (d != l) {
+        _do_move_backward(base + l*s, base + d*s, new_size - l);
+    }
+    mCount = new_size;
+}
+
+int SortedVectorImpl::compareProxy(const void* lhs, const void* rhs, void* self)
+{
+    return static_cast<const SortedVectorImpl*>(self)->do_compare(lhs, rhs);
+}
+
+ssize_t SortedVectorImpl::removeRange(const void* lo, const void* hi)
+{
+    // the keys are unique: orderOf() is the index of the first key >= item
+    const size_t first = orderOf(lo);
+    const size_t last = orderOf(hi);
+    if (last <= first) {
+        return 0;
+    }
+    ssize_t err = VectorImpl::removeItemsAt(first, last - first);
+    return err < 0 ? err : ssize_t(last - first);
+}
+
 ssize_t SortedVectorImpl::remove(const void* item)
 {
     ssize_t i = indexOf(item);
@@ -22,6 +22,8 @@
 #include <sys/types.h>
 #include <utils/Errors.h>
 
+#include <type_traits>
+
 // ---------------------------------------------------------------------------
 // No user serviceable parts in here...
 // ---------------------------------------------------------------------------
@@ -44,16 +46,26 @@ public:
         HAS_TRIVIAL_CTOR    = 0x00000001,
         HAS_TRIVIAL_DTOR    = 0x00000002,
         HAS_TRIVIAL_COPY    = 0x00000004,
+        // items can be moved with memcpy(), leaving nothing to destroy
+        // behind (sp<>, String8...), even if copying them can't
+        HAS_TRIVIAL_MOVE    = 0x00000008,
     };
 
                             VectorImpl(size_t itemSize, uint32_t flags);
                             VectorImpl(const VectorImpl& rhs);
+    /*! takes the storage of rhs, leaving it empty, without touching the
+     *  reference count */
+                            VectorImpl(VectorImpl&& rhs);
     virtual                 ~VectorImpl();
 
     /*! must be called from subclasses destructor */
             void            finish_vector();
 
             VectorImpl&     operator = (const VectorImpl& rhs);
+            VectorImpl&     operator = (VectorImpl&& rhs);
+
+    /*! exchanges the contents of two vectors of the same type */
+            void            swap(VectorImpl& rhs);
 
     /*! C-style array access */
     inline  const void*     arrayImpl() const       { return mStorage; }
@@ -66,6 +78,17 @@ public:
             ssize_t         setCapacity(size_t size);
             ssize_t         resize(size_t size);
 
+            /*! makes room for size items, in storage of its own, and keeps
+             *  it: removals don't give it back. Until it outgrows it, or is
+             *  copied from, the vector no longer allocates, which is what a
+             *  real-time thread needs (see NV_VectorRealtime.h). Call it
+             *  beforehand, from another thread; 0 drops the reservation.
+             *  It follows the storage through moves and swap(), but not
+             *  through a memcpy() of the vector itself, like an item of a
+             *  HAS_TRIVIAL_MOVE vector gets: that one loses it.
+             *  Returns the capacity. */
+            ssize_t         reserve(size_t size);
+
             /*! append/insert another vector or array */
             ssize_t         insertVectorAt(const VectorImpl& vector, size_t index);
             ssize_t         appendVector(const VectorImpl& vector);
@@ -83,10 +106,43 @@ public:
             ssize_t         replaceAt(size_t index);
             ssize_t         replaceAt(const void* item, size_t index);
 
+            /*! replaces length items from index with those of array, in a
+             *  single copy */
+            ssize_t         replaceArrayAt(const void* array, size_t index, size_t length);
+
+            /*! makes the storage unique once and returns count writable items
+             *  from index, NULL if they're out of bounds. The span is valid
+             *  until the vector is next resized or copied. */
+            void*           editItemRange(size_t index, size_t count);
+
             /*! remove items */
             ssize_t         removeItemsAt(size_t index, size_t count = 1);
             void            clear();
 
+            /*! batch of edits, indices refer to the vector before the batch */
+            struct Insertion {
+                size_t          index;  // insert before this item
+                const void*     items;  // NULL for default-constructed items
+                size_t          count;
+            };
+            struct Removal {
+                size_t          index;
+                size_t          count;
+            };
+
+            /*! removes and inserts at many positions in one pass over the
+             *  storage, reallocating at most once. Both lists are sorted by
+             *  index, removals don't overlap, and insertions into a removed
+             *  range land where the range was. The inserted items can't live
+             *  in this vector. Returns the new size */
+            ssize_t         editBatch(const Insertion* insertions, size_t numInsertions,
+                                      const Removal* removals, size_t numRemovals);
+
+            typedef bool (*predicate_r_t)(const void* item, void* state);
+            /*! removes every item pred is true for, in a single pass.
+             *  Returns how many items were removed */
+            ssize_t         removeItemsIf(predicate_r_t pred, void* state);
+
             const void*     itemLocation(size_t index) const;
             void*           editItemLocation(size_t index);
 
@@ -95,6 +151,13 @@ public:
             status_t        sort(compar_t cmp);
             status_t        sort(compar_r_t cmp, void* state);
 
+            /*! stable LSD radix sort on the integer key keyWidth (1, 2, 4
+             *  or 8) bytes wide at keyOffset in each item, in native byte
+             *  order. No comparator is called: HAS_TRIVIAL_COPY items are
+             *  memcpy'd through one scratch buffer, a byte of the key per
+             *  pass. Others get INVALID_OPERATION. */
+            status_t        radixSort(size_t keyOffset, size_t keyWidth, bool isSigned);
+
 protected:
             size_t          itemSize() const;
             void            release_storage();
@@ -116,8 +179,23 @@ protected:
     virtual void            reservedVectorImpl8();
 
 private:
+    friend class VectorImplSorter;
+    friend class VectorImplParallelSorter;
+    friend class SortedVectorImpl;
+    friend class ChunkedSortedVectorImpl;
+    friend class VectorSlack;
+    friend class SortedVectorSnapshot;
+    friend class PublishedVectorImpl;
+
         void* _grow(size_t where, size_t amount);
         void  _shrink(size_t where, size_t amount);
+        bool  _relocatable() const;
+        void  _release_relocated();
+        // a reference on count items of this type, which may not be ours
+        void  _release_storage(void* storage, size_t count) const;
+        // destroys count items of storage nobody holds anymore, and frees it
+        void  _free_storage(void* storage, size_t count) const;
+        void  _forgetStaleReservation() const;
 
         inline void _do_construct(void* storage, size_t num) const;
         inline void _do_destroy(void* storage, size_t num) const;
@@ -125,6 +203,7 @@ private:
         inline void _do_splat(void* dest, const void* item, size_t num) const;
         inline void _do_move_forward(void* dest, const void* from, size_t num) const;
         inline void _do_move_backward(void* dest, const void* from, size_t num) const;
+        inline void _do_relocate(void* dest, void* from, size_t num) const;
 
             // These 2 fields are exposed in the inlines below,
             // so they're set in stone.
@@ -142,9 +221,14 @@ class SortedVectorImpl : public VectorImpl
 public:
                             SortedVectorImpl(size_t itemSize, uint32_t flags);
                             SortedVectorImpl(const VectorImpl& rhs);
+                            // declaring the move constructor deletes the
+                            // implicit copy constructor: spell it out
+                            SortedVectorImpl(const SortedVectorImpl& rhs);
+                            SortedVectorImpl(SortedVectorImpl&& rhs);
     virtual                 ~SortedVectorImpl();
 
     SortedVectorImpl&     operator = (const SortedVectorImpl& rhs);
+    SortedVectorImpl&     operator = (SortedVectorImpl&& rhs);
 
     //! finds the index of an item
             ssize_t         indexOf(const void* item) const;
@@ -152,9 +236,26 @@ public:
     //! finds where this item should be inserted
             size_t          orderOf(const void* item) const;
 
+    /*! indexOf() and orderOf() of count items at once, orders may be NULL.
+     *  A lookup of an item that's not smaller than the previous one starts
+     *  from where that one ended, so sorted queries cost O(log distance) */
+            void            indexOfBatch(const void* items, size_t count,
+                                         ssize_t* indices, size_t* orders = 0) const;
+
+    /*! the same for a vector ordered by a leading integral or pointer KEY
+     *  compared with operator<, e.g. a SortedVector<int32_t> or a
+     *  KeyedVector<void*, V>, without any virtual call */
+    template <typename KEY>
+            void            indexOfKeys(const KEY* keys, size_t count,
+                                        ssize_t* indices, size_t* orders = 0) const;
+
     //! add an item in the right place (or replaces it if there is one)
             ssize_t         add(const void* item);
 
+    /*! the same, searching outward from hint, the index returned by the
+     *  previous add(): runs of nearby items cost O(log distance) each */
+            ssize_t         add(const void* item, size_t hint);
+
     //! merges a vector into this one
             ssize_t         merge(const VectorImpl& vector);
             ssize_t         merge(const SortedVectorImpl& vector);
@@ -162,6 +263,9 @@ public:
     //! removes an item
             ssize_t         remove(const void* item);
 
+    //! removes the items in [lo, hi), returns how many there were
+            ssize_t         removeRange(const void* lo, const void* hi);
+
 protected:
     virtual int             do_compare(const void* lhs, const void* rhs) const = 0;
 
@@ -175,7 +279,20 @@ protected:
     virtual void            reservedSortedVectorImpl8();
 
 private:
+    friend class SortedVectorHashIndex;
+
             ssize_t         _indexOrderOf(const void* item, size_t* order = 0) const;
+            ssize_t         _indexOrderOfRange(const void* item, size_t* order,
+                                               size_t lo, size_t hi) const;
+            ssize_t         _indexOrderOfNear(const void* item, size_t* order,
+                                              size_t hint) const;
+    template <typename COMPARE>
+            void            _lookupBatch(const void* keys, size_t keyStride, size_t count,
+                                         ssize_t* indices, size_t* orders,
+                                         const COMPARE& compare) const;
+            ssize_t         _merge(const void* array, size_t length);
+            void            _mergeInPlace(const void* array, size_t length);
+    static  int             compareProxy(const void* lhs, const void* rhs, void* self);
 
             // these are made private, because they can't be used on a SortedVector
             // (they don't have an implementation either)
@@ -191,8 +308,84 @@ private:
             ssize_t         insertAt(const void* item, size_t where, size_t numItems = 1);
             ssize_t         replaceAt(size_t index);
             ssize_t         replaceAt(const void* item, size_t index);
+            ssize_t         replaceArrayAt(const void* array, size_t index, size_t length);
+            ssize_t         editBatch(const Insertion* insertions, size_t numInsertions,
+                                      const Removal* removals, size_t numRemovals);
+};
+
+// ---------------------------------------------------------------------------
+
+template <typename KEY>
+struct SortedKeyCompare {
+    static_assert(std::is_integral<KEY>::value || std::is_pointer<KEY>::value,
+            "indexOfKeys() only knows how to order integral and pointer keys");
+    inline int operator()(const void* lhs, const void* rhs) const {
+        const KEY l = *reinterpret_cast<const KEY*>(lhs);
+        const KEY r = *reinterpret_cast<const KEY*>(rhs);
+        return (r < l) - (l < r);
+    }
 };
 
+template <typename KEY>
+void SortedVectorImpl::indexOfKeys(const KEY* keys, size_t count,
+        ssize_t* indices, size_t* orders) const
+{
+    _lookupBatch(keys, sizeof(KEY), count, indices, orders, SortedKeyCompare<KEY>());
+}
+
+template <typename COMPARE>
+void SortedVectorImpl::_lookupBatch(const void* keys, size_t keyStride, size_t count,
+        ssize_t* indices, size_t* orders, const COMPARE& compare) const
+{
+    const char* const a = reinterpret_cast<const char*>(arrayImpl());
+    const size_t n = size();
+    const size_t s = itemSize();
+    const char* key = reinterpret_cast<const char*>(keys);
+    const char* previous = 0;
+    size_t lo = 0;  // every item before lo is smaller than the previous key
+    for (size_t i = 0 ; i < count ; i++, previous = key, key += keyStride) {
+        size_t end = n;
+        if (!previous || compare(key, previous) < 0) {
+            lo = 0;
+        } else {
+            // gallop from the previous match to bracket this one
+            size_t step = 1;
+            for (;;) {
+                const size_t probe = lo + step - 1;
+                if (probe >= n) {
+                    break;
+                }
+                if (compare(a + probe*s, key) >= 0) {
+                    end = probe;
+                    break;
+                }
+                lo = probe + 1;
+                step <<= 1;
+            }
+        }
+
+        // branch-free lower bound in [lo, end]: the probes only feed
+        // conditional moves, and both possible next probes get prefetched
+        size_t base = lo;
+        size_t len = end - lo;
+        while (len > 1) {
+            const size_t half = len / 2;
+            __builtin_prefetch(a + (base + half/2)*s);
+            __builtin_prefetch(a + (base + half + half/2)*s);
+            base = compare(a + (base + half)*s, key) < 0 ? base + half : base;
+            len -= half;
+        }
+        const size_t order = base + (len && compare(a + base*s, key) < 0);
+
+        indices[i] = (order < n && compare(a + order*s, key) == 0) ?
+                ssize_t(order) : ssize_t(NAME_NOT_FOUND);
+        if (orders) {
+            orders[i] = order;
+        }
+        lo = order;
+    }
+}
+
 }; // namespace android
 
 
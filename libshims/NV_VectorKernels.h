@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTOR_KERNELS_H
+#define NV_VECTOR_KERNELS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Copy, move and splat of trivially copyable items, for VectorImpl.
+ *
+ * They're written with GCC/clang vector extensions: a 16-byte vector is a
+ * NEON q register on armv7-a-neon, an SSE register on x86, and plain
+ * scalar code anywhere else. Items of 4, 8, 16 and 32 bytes are splatted
+ * 64 bytes per iteration from a register pattern; the typed do_splat()
+ * of the subclass does as well for the others. Copies and moves of up to
+ * 64 bytes, the usual single-item insert or shift, are done inline through
+ * registers: everything is loaded before anything is stored, so
+ * overlapping moves need no direction. Larger ones, and other item sizes,
+ * go to the libc routines, which are already vectorized.
+ */
+
+typedef uint8_t vector_u8x16 __attribute__((vector_size(16)));
+
+enum {
+    VECTOR_KERNEL_INLINE_MAX = 64,
+};
+
+inline bool vectorKernelItemSize(size_t itemSize) {
+    return itemSize == 4 || itemSize == 8 || itemSize == 16 || itemSize == 32;
+}
+
+inline vector_u8x16 vectorLoad16(const void* p) {
+    vector_u8x16 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void vectorStore16(void* p, vector_u8x16 v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+// moves 4 to VECTOR_KERNEL_INLINE_MAX bytes through registers, the last
+// chunk overlapping the ones before when bytes isn't a multiple of it
+inline void vectorMoveSmall(void* dest, const void* from, size_t bytes)
+{
+    char* d = static_cast<char*>(dest);
+    const char* s = static_cast<const char*>(from);
+    if (bytes > 32) {
+        const vector_u8x16 v0 = vectorLoad16(s);
+        const vector_u8x16 v1 = vectorLoad16(s + 16);
+        const vector_u8x16 v2 = vectorLoad16(s + bytes - 32);
+        const vector_u8x16 v3 = vectorLoad16(s + bytes - 16);
+        vectorStore16(d, v0);
+        vectorStore16(d + 16, v1);
+        vectorStore16(d + bytes - 32, v2);
+        vectorStore16(d + bytes - 16, v3);
+    } else if (bytes >= 16) {
+        const vector_u8x16 v0 = vectorLoad16(s);
+        const vector_u8x16 v1 = vectorLoad16(s + bytes - 16);
+        vectorStore16(d, v0);
+        vectorStore16(d + bytes - 16, v1);
+    } else if (bytes >= 8) {
+        uint64_t a, b;
+        memcpy(&a, s, 8);
+        memcpy(&b, s + bytes - 8, 8);
+        memcpy(d, &a, 8);
+        memcpy(d + bytes - 8, &b, 8);
+    } else {
+        uint32_t a, b;
+        memcpy(&a, s, 4);
+        memcpy(&b, s + bytes - 4, 4);
+        memcpy(d, &a, 4);
+        memcpy(d + bytes - 4, &b, 4);
+    }
+}
+
+//! copies num non-overlapping items
+inline void vectorCopy(void* dest, const void* from, size_t num, size_t itemSize)
+{
+    const size_t bytes = num*itemSize;
+    if (bytes <= VECTOR_KERNEL_INLINE_MAX && vectorKernelItemSize(itemSize)) {
+        if (bytes) {
+            vectorMoveSmall(dest, from, bytes);
+        }
+    } else {
+        memcpy(dest, from, bytes);
+    }
+}
+
+//! moves num items to a possibly overlapping place
+inline void vectorMove(void* dest, const void* from, size_t num, size_t itemSize)
+{
+    const size_t bytes = num*itemSize;
+    if (bytes <= VECTOR_KERNEL_INLINE_MAX && vectorKernelItemSize(itemSize)) {
+        if (bytes) {
+            vectorMoveSmall(dest, from, bytes);
+        }
+    } else {
+        memmove(dest, from, bytes);
+    }
+}
+
+//! stores num copies of item, itemSize being one vectorKernelItemSize() takes
+inline void vectorSplat(void* dest, const void* item, size_t num, size_t itemSize)
+{
+    typedef uint32_t vector_u32x4 __attribute__((vector_size(16)));
+    typedef uint64_t vector_u64x2 __attribute__((vector_size(16)));
+
+    char* d = static_cast<char*>(dest);
+    size_t bytes = num*itemSize;
+    if (bytes <= 32) {
+        // mostly insertAt() of a single item, not worth a pattern
+        for ( ; bytes ; bytes -= itemSize, d += itemSize) {
+            vectorMoveSmall(d, item, itemSize);
+        }
+        return;
+    }
+
+    // two registers holding whole items, a vdup on NEON for the small ones
+    vector_u8x16 v0, v1;
+    if (itemSize == 4) {
+        uint32_t x;
+        memcpy(&x, item, sizeof(x));
+        const vector_u32x4 v = { x, x, x, x };
+        v0 = v1 = (vector_u8x16)v;
+    } else if (itemSize == 8) {
+        uint64_t x;
+        memcpy(&x, item, sizeof(x));
+        const vector_u64x2 v = { x, x };
+        v0 = v1 = (vector_u8x16)v;
+    } else if (itemSize == 16) {
+        v0 = v1 = vectorLoad16(item);
+    } else {
+        v0 = vectorLoad16(item);
+        v1 = vectorLoad16(static_cast<const char*>(item) + 16);
+    }
+    for ( ; bytes >= 64 ; bytes -= 64, d += 64) {
+        vectorStore16(d, v0);
+        vectorStore16(d + 16, v1);
+        vectorStore16(d + 32, v0);
+        vectorStore16(d + 48, v1);
+    }
+    if (bytes >= 32) {
+        vectorStore16(d, v0);
+        vectorStore16(d + 16, v1);
+        bytes -= 32;
+        d += 32;
+    }
+
+    // what's left is smaller items, which v0 starts with whole copies of
+    if (bytes >= 16) {
+        vectorStore16(d, v0);
+        bytes -= 16;
+        d += 16;
+    }
+    if (bytes >= 8) {
+        memcpy(d, &v0, 8);
+        bytes -= 8;
+        d += 8;
+    }
+    if (bytes) {
+        memcpy(d, &v0, 4);
+    }
+}
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // NV_VECTOR_KERNELS_H
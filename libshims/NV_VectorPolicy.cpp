@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VectorPolicy"
+
+#include <stdio.h>
+
+#include <atomic>
+
+#include <log/log.h>
+
+#include "NV_VectorConfig.h"
+#include "NV_VectorPolicy.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+namespace {
+
+const size_t kDefaultGrowPercent = 150;
+const size_t kMinGrowPercent = 100;
+const size_t kMaxGrowPercent = 400;
+
+const size_t kDefaultShrinkDivisor = 4;
+const size_t kMaxShrinkDivisor = 64;
+
+// defaults until loadPolicy() has run
+size_t gGrowPercent = kDefaultGrowPercent;
+size_t gShrinkDivisor = kDefaultShrinkDivisor;
+
+// reallocations are rare next to the copies they do, so shared counters
+// are cheap enough here
+std::atomic<uint64_t> gEvents[VectorPolicy::NUM_EVENTS];
+
+const char* const kEventNames[VectorPolicy::NUM_EVENTS] = {
+    "grow", "grow in place", "shrink", "shrink in place",
+    "shrink deferred", "setCapacity",
+};
+
+// runs when the shim is loaded, before the libraries that depend on it
+__attribute__((constructor))
+void loadPolicy()
+{
+    size_t percent = vectorConfigSize("VECTORIMPL_GROW_PERCENT", kDefaultGrowPercent);
+    if (percent < kMinGrowPercent || percent > kMaxGrowPercent) {
+        ALOGW("VECTORIMPL_GROW_PERCENT=%zu out of [%zu, %zu], using %zu",
+                percent, kMinGrowPercent, kMaxGrowPercent, kDefaultGrowPercent);
+        percent = kDefaultGrowPercent;
+    }
+
+    // a divisor of 1 would reallocate on every removal
+    size_t divisor = vectorConfigSize("VECTORIMPL_SHRINK_DIVISOR", kDefaultShrinkDivisor);
+    if (divisor == 1 || divisor > kMaxShrinkDivisor) {
+        ALOGW("VECTORIMPL_SHRINK_DIVISOR=%zu out of [2, %zu], using %zu",
+                divisor, kMaxShrinkDivisor, kDefaultShrinkDivisor);
+        divisor = kDefaultShrinkDivisor;
+    }
+
+    gGrowPercent = percent;
+    gShrinkDivisor = divisor;
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+size_t VectorPolicy::grownCapacity(size_t newSize)
+{
+    // newSize * extra / 100, without overflowing the multiplication
+    const size_t extra = gGrowPercent - 100;
+    const size_t slack = (newSize / 100) * extra + (newSize % 100) * extra / 100;
+    const size_t capacity = newSize + slack + 1;
+    return capacity > newSize ? capacity : 0;
+}
+
+bool VectorPolicy::shouldShrink(size_t newSize, size_t capacity)
+{
+    if (gShrinkDivisor && newSize < capacity / gShrinkDivisor) {
+        return true;
+    }
+    if (newSize < capacity / 2) {
+        count(SHRINK_DEFERRED);
+    }
+    return false;
+}
+
+void VectorPolicy::count(Event event)
+{
+    gEvents[event].fetch_add(1, std::memory_order_relaxed);
+}
+
+void VectorPolicy::getStats(Stats* stats)
+{
+    stats->growPercent = gGrowPercent;
+    stats->shrinkDivisor = gShrinkDivisor;
+    for (int i = 0 ; i < NUM_EVENTS ; i++) {
+        stats->events[i] = gEvents[i].load(std::memory_order_relaxed);
+    }
+}
+
+void VectorPolicy::dumpStats(int fd)
+{
+    Stats stats;
+    getStats(&stats);
+    if (stats.shrinkDivisor) {
+        dprintf(fd, "VectorPolicy: grow %zu%%, shrink below 1/%zu\n",
+                stats.growPercent, stats.shrinkDivisor);
+    } else {
+        dprintf(fd, "VectorPolicy: grow %zu%%, never shrink\n", stats.growPercent);
+    }
+    for (int i = 0 ; i < NUM_EVENTS ; i++) {
+        dprintf(fd, "%16s %12llu\n", kEventNames[i], (unsigned long long)stats.events[i]);
+    }
+}
+
+}; // namespace android
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTOR_POLICY_H
+#define NV_VECTOR_POLICY_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * How VectorImpl storage grows and shrinks. The policy is picked once per
+ * process, when the shim is loaded, so vectors never see it change.
+ *
+ * Growing allocates room for growPercent% of the new size, plus one item.
+ * Shrinking only happens once fewer than capacity/shrinkDivisor items are
+ * left, and then leaves room for twice the remaining items: with the
+ * default divisor of 4, a vector has to lose half of its items again
+ * before it reallocates a second time, so a size that oscillates around
+ * a threshold no longer reallocates on every push/pop.
+ *
+ * Tunables:
+ *   VECTORIMPL_GROW_PERCENT    capacity after growing, in percent of the
+ *                              new size (default 150, 100 to 400)
+ *   VECTORIMPL_SHRINK_DIVISOR  shrink below capacity/N items (default 4;
+ *                              2 is the historical behaviour, 0 never
+ *                              shrinks)
+ */
+class VectorPolicy
+{
+public:
+    //! capacity to grow to so that newSize items fit, 0 on overflow
+    static  size_t          grownCapacity(size_t newSize);
+
+    //! true if a vector of that capacity shrunk to newSize items should
+    //! give memory back
+    static  bool            shouldShrink(size_t newSize, size_t capacity);
+
+    enum Event {
+        GROW,               // _grow() copied into a new buffer
+        GROW_IN_PLACE,      // _grow() resized its buffer
+        SHRINK,             // _shrink() copied into a new buffer
+        SHRINK_IN_PLACE,    // _shrink() resized its buffer
+        SHRINK_DEFERRED,    // removals the historical policy shrinks on
+        SET_CAPACITY,       // setCapacity() copied into a new buffer
+        NUM_EVENTS
+    };
+
+    static  void            count(Event event);
+
+    struct Stats {
+        size_t      growPercent;
+        size_t      shrinkDivisor;
+        uint64_t    events[NUM_EVENTS];
+    };
+
+    static  void            getStats(Stats* stats);
+
+    //! writes the policy and its counters as text
+    static  void            dumpStats(int fd);
+};
+
+}; // namespace android
+
+#endif // NV_VECTOR_POLICY_H
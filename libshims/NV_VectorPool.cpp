@@ -0,0 +1,525 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VectorPool"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <new>
+
+#include <log/log.h>
+#include <utils/SharedBuffer.h>
+
+#include "NV_VectorConfig.h"
+#include "NV_VectorPool.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+namespace {
+
+const size_t kDefaultArenaSize = 8 * 1024 * 1024;
+
+// the thread caches hold at most this many bytes per size class
+const size_t kThreadCacheBytes = 64 * 1024;
+
+// SharedBuffer's constructor is private: pool blocks get their header
+// written through this mirror of its layout instead.
+struct SharedBufferHeader {
+    int32_t     refs;
+    size_t      size;
+    uint32_t    reserved[2];
+};
+
+static_assert(sizeof(SharedBufferHeader) == sizeof(SharedBuffer),
+        "SharedBuffer layout changed");
+
+struct FreeBlock {
+    FreeBlock*  next;
+};
+
+enum {
+    ALLOCS,
+    CACHE_HITS,
+    LIST_HITS,
+    FRESH,
+    FALLBACKS,
+    FREES,
+    RESIZES_IN_PLACE,
+    NUM_COUNTERS
+};
+
+// Written only by the thread owning them, read by anyone: relaxed
+// load/store pairs, no read-modify-write needed.
+struct Counters {
+    std::atomic<uint64_t>   values[NUM_COUNTERS];
+};
+
+inline void bump(Counters& counters, int which) {
+    std::atomic<uint64_t>& counter = counters.values[which];
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// the extra slot counts requests that are too big for any class
+const int kOversize = VectorPool::NUM_CLASSES;
+
+struct ThreadCache {
+    FreeBlock*      bins[VectorPool::NUM_CLASSES];
+    size_t          counts[VectorPool::NUM_CLASSES];
+    Counters        counters[VectorPool::NUM_CLASSES + 1];
+    ThreadCache*    next;
+    ThreadCache*    prev;
+};
+
+struct SizeClass {
+    pthread_mutex_t lock;
+    FreeBlock*      freeList;
+    char*           bump;       // next never-used block of the region
+    char*           end;
+};
+
+pthread_once_t gOnce = PTHREAD_ONCE_INIT;
+bool gEnabled = false;
+char* gArenaBase = 0;
+char* gArenaEnd = 0;
+size_t gRegionSize = 0;
+SizeClass gClasses[VectorPool::NUM_CLASSES];
+pthread_key_t gCacheKey;
+
+// live thread caches, and the counters of the threads that are gone
+pthread_mutex_t gRegistryLock = PTHREAD_MUTEX_INITIALIZER;
+ThreadCache* gCaches = 0;
+uint64_t gRetired[VectorPool::NUM_CLASSES + 1][NUM_COUNTERS];
+
+inline size_t blockSize(int cls) {
+    return size_t(1) << (cls + VectorPool::MIN_BLOCK_SHIFT);
+}
+
+inline size_t cacheLimit(int cls) {
+    const size_t limit = kThreadCacheBytes / blockSize(cls);
+    return limit < 4 ? 4 : (limit > 64 ? 64 : limit);
+}
+
+// size class for a buffer of 'size' bytes of data, -1 if it's too big
+inline int classOf(size_t size) {
+    if (size > VectorPool::MAX_BLOCK - sizeof(SharedBuffer)) {
+        return -1;
+    }
+    const unsigned long total = size + sizeof(SharedBuffer) - 1;
+    const int shift = int(sizeof(unsigned long) * 8) - __builtin_clzl(total);
+    return shift <= VectorPool::MIN_BLOCK_SHIFT ? 0 : shift - VectorPool::MIN_BLOCK_SHIFT;
+}
+
+inline int classOfBlock(const void* block) {
+    return int((reinterpret_cast<const char*>(block) - gArenaBase) / gRegionSize);
+}
+
+inline SharedBuffer* initBlock(FreeBlock* block, size_t size) {
+    SharedBufferHeader* header = new (block) SharedBufferHeader;
+    header->refs = 1;
+    header->size = size;
+    header->reserved[0] = 0;
+    header->reserved[1] = 0;
+    return reinterpret_cast<SharedBuffer*>(header);
+}
+
+void pushGlobal(int cls, FreeBlock* first, FreeBlock* last) {
+    SizeClass& sc = gClasses[cls];
+    pthread_mutex_lock(&sc.lock);
+    last->next = sc.freeList;
+    sc.freeList = first;
+    pthread_mutex_unlock(&sc.lock);
+}
+
+void destroyCache(void* data)
+{
+    ThreadCache* cache = static_cast<ThreadCache*>(data);
+    for (int cls = 0 ; cls < VectorPool::NUM_CLASSES ; cls++) {
+        FreeBlock* first = cache->bins[cls];
+        if (first) {
+            FreeBlock* last = first;
+            while (last->next) last = last->next;
+            pushGlobal(cls, first, last);
+        }
+    }
+    pthread_mutex_lock(&gRegistryLock);
+    for (int cls = 0 ; cls <= VectorPool::NUM_CLASSES ; cls++) {
+        for (int i = 0 ; i < NUM_COUNTERS ; i++) {
+            gRetired[cls][i] += cache->counters[cls].values[i].load(std::memory_order_relaxed);
+        }
+    }
+    if (cache->prev) cache->prev->next = cache->next;
+    else gCaches = cache->next;
+    if (cache->next) cache->next->prev = cache->prev;
+    pthread_mutex_unlock(&gRegistryLock);
+    delete cache;
+}
+
+// SharedBuffer::release(uint32_t) and SharedBuffer::dealloc(const SharedBuffer*)
+const char* const kReleaseSymbols[] = {
+    "_ZNK7android12SharedBuffer7releaseEj",
+    "_ZN7android12SharedBuffer7deallocEPKS0_",
+};
+
+void initPool()
+{
+    if (!vectorConfigBool("VECTORIMPL_POOL", false)) {
+        return;
+    }
+    // the process must call the versions of kReleaseSymbols at the bottom
+    // of this file, and not libutils' own
+    if (!vectorShimResolves("pool", kReleaseSymbols,
+            sizeof(kReleaseSymbols) / sizeof(kReleaseSymbols[0]))) {
+        return;
+    }
+
+    // every region is a multiple of the biggest block, so that all blocks
+    // of every class stay naturally aligned
+    const size_t arena = vectorConfigSize("VECTORIMPL_POOL_ARENA", kDefaultArenaSize);
+    size_t region = (arena / VectorPool::NUM_CLASSES) & ~size_t(VectorPool::MAX_BLOCK - 1);
+    if (region < VectorPool::MAX_BLOCK) {
+        region = VectorPool::MAX_BLOCK;
+    }
+
+    // pages are only committed when blocks are first handed out
+    void* base = mmap(NULL, region * VectorPool::NUM_CLASSES, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("can't map a %zu bytes pool arena, pool disabled", region * VectorPool::NUM_CLASSES);
+        return;
+    }
+    if (pthread_key_create(&gCacheKey, destroyCache)) {
+        ALOGE("can't create the thread cache key, pool disabled");
+        munmap(base, region * VectorPool::NUM_CLASSES);
+        return;
+    }
+
+    gArenaBase = static_cast<char*>(base);
+    gArenaEnd = gArenaBase + region * VectorPool::NUM_CLASSES;
+    gRegionSize = region;
+    for (int cls = 0 ; cls < VectorPool::NUM_CLASSES ; cls++) {
+        pthread_mutex_init(&gClasses[cls].lock, NULL);
+        gClasses[cls].freeList = 0;
+        gClasses[cls].bump = gArenaBase + cls * region;
+        gClasses[cls].end = gClasses[cls].bump + region;
+    }
+    gEnabled = true;
+}
+
+ThreadCache* getCache()
+{
+    ThreadCache* cache = static_cast<ThreadCache*>(pthread_getspecific(gCacheKey));
+    if (!cache) {
+        cache = new (std::nothrow) ThreadCache();
+        if (!cache) {
+            return 0;
+        }
+        pthread_setspecific(gCacheKey, cache);
+        pthread_mutex_lock(&gRegistryLock);
+        cache->next = gCaches;
+        if (gCaches) gCaches->prev = cache;
+        gCaches = cache;
+        pthread_mutex_unlock(&gRegistryLock);
+    }
+    return cache;
+}
+
+// Takes a batch of blocks from the global free list, or carves a new batch
+// out of the arena. Returns one block and puts the others in the cache.
+FreeBlock* refill(ThreadCache* cache, int cls)
+{
+    const size_t batch = cacheLimit(cls) / 2;
+    const size_t size = blockSize(cls);
+    SizeClass& sc = gClasses[cls];
+    FreeBlock* block = 0;
+
+    pthread_mutex_lock(&sc.lock);
+    if (sc.freeList) {
+        block = sc.freeList;
+        FreeBlock* last = block;
+        size_t n = 1;
+        while (n < batch && last->next) {
+            last = last->next;
+            n++;
+        }
+        sc.freeList = last->next;
+        last->next = 0;
+        pthread_mutex_unlock(&sc.lock);
+        bump(cache->counters[cls], LIST_HITS);
+    } else if (sc.bump != sc.end) {
+        size_t n = size_t(sc.end - sc.bump) / size;
+        if (n > batch) n = batch;
+        char* first = sc.bump;
+        sc.bump += n * size;
+        pthread_mutex_unlock(&sc.lock);
+        for (size_t i = 0 ; i < n ; i++) {
+            reinterpret_cast<FreeBlock*>(first + i*size)->next =
+                    (i + 1 < n) ? reinterpret_cast<FreeBlock*>(first + (i + 1)*size) : 0;
+        }
+        block = reinterpret_cast<FreeBlock*>(first);
+        bump(cache->counters[cls], FRESH);
+    } else {
+        pthread_mutex_unlock(&sc.lock);
+        return 0;
+    }
+
+    cache->bins[cls] = block->next;
+    for (FreeBlock* b = block->next ; b ; b = b->next) {
+        cache->counts[cls]++;
+    }
+    return block;
+}
+
+void addCounters(VectorPool::Stats* stats, const uint64_t* values)
+{
+    stats->allocs += values[ALLOCS];
+    stats->cacheHits += values[CACHE_HITS];
+    stats->listHits += values[LIST_HITS];
+    stats->fresh += values[FRESH];
+    stats->fallbacks += values[FALLBACKS];
+    stats->frees += values[FREES];
+    stats->resizesInPlace += values[RESIZES_IN_PLACE];
+}
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+
+bool VectorPool::isEnabled()
+{
+    pthread_once(&gOnce, initPool);
+    return gEnabled;
+}
+
+bool VectorPool::owns(const SharedBuffer* buffer)
+{
+    const char* p = reinterpret_cast<const char*>(buffer);
+    return isEnabled() && p >= gArenaBase && p < gArenaEnd;
+}
+
+SharedBuffer* VectorPool::alloc(size_t size)
+{
+    if (!isEnabled()) {
+        return SharedBuffer::alloc(size);
+    }
+    ThreadCache* cache = getCache();
+    const int cls = classOf(size);
+    if (cache) {
+        Counters& c = cache->counters[cls < 0 ? kOversize : cls];
+        bump(c, ALLOCS);
+        if (cls >= 0) {
+            FreeBlock* block = cache->bins[cls];
+            if (block) {
+                cache->bins[cls] = block->next;
+                cache->counts[cls]--;
+                bump(c, CACHE_HITS);
+                return initBlock(block, size);
+            }
+            block = refill(cache, cls);
+            if (block) {
+                return initBlock(block, size);
+            }
+        }
+        bump(c, FALLBACKS);
+    }
+    return SharedBuffer::alloc(size);
+}
+
+void VectorPool::dealloc(const SharedBuffer* released)
+{
+    if (!owns(released)) {
+        SharedBuffer::dealloc(released);
+        return;
+    }
+    const int cls = classOfBlock(released);
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(const_cast<SharedBuffer*>(released));
+    ThreadCache* cache = getCache();
+    if (!cache) {
+        pushGlobal(cls, block, block);
+        return;
+    }
+    bump(cache->counters[cls], FREES);
+    block->next = cache->bins[cls];
+    cache->bins[cls] = block;
+    if (++cache->counts[cls] > cacheLimit(cls)) {
+        // give half of the cache back, so other threads can use it
+        size_t keep = cacheLimit(cls) / 2;
+        FreeBlock* last = block;
+        for (size_t i = 1 ; i < keep ; i++) {
+            last = last->next;
+        }
+        FreeBlock* first = last->next;
+        last->next = 0;
+        FreeBlock* tail = first;
+        while (tail->next) tail = tail->next;
+        cache->counts[cls] = keep;
+        pushGlobal(cls, first, tail);
+    }
+}
+
+SharedBuffer* VectorPool::editResize(const SharedBuffer* buffer, size_t size)
+{
+    const int cls = isEnabled() ? classOf(size) : -1;
+    if (!owns(buffer)) {
+        if (cls < 0) {
+            return buffer->editResize(size);
+        }
+        // bring the buffer into the pool
+        SharedBuffer* sb = alloc(size);
+        if (sb) {
+            memcpy(sb->data(), buffer->data(), size < buffer->size() ? size : buffer->size());
+            buffer->release();
+        }
+        return sb;
+    }
+
+    if (buffer->onlyOwner() && cls == classOfBlock(buffer)) {
+        // still the right class, just update the header
+        SharedBufferHeader* header = reinterpret_cast<SharedBufferHeader*>(
+                const_cast<SharedBuffer*>(buffer));
+        header->size = size;
+        ThreadCache* cache = getCache();
+        if (cache) {
+            bump(cache->counters[cls], RESIZES_IN_PLACE);
+        }
+        return const_cast<SharedBuffer*>(buffer);
+    }
+    SharedBuffer* sb = alloc(size);
+    if (sb) {
+        memcpy(sb->data(), buffer->data(), size < buffer->size() ? size : buffer->size());
+        if (buffer->release(SharedBuffer::eKeepStorage) == 1) {
+            dealloc(buffer);
+        }
+    }
+    return sb;
+}
+
+bool VectorPool::getStats(Stats* perClass, Stats* total)
+{
+    if (!isEnabled()) {
+        return false;
+    }
+    Stats stats[NUM_CLASSES + 1];
+    memset(stats, 0, sizeof(stats));
+    pthread_mutex_lock(&gRegistryLock);
+    for (int cls = 0 ; cls <= NUM_CLASSES ; cls++) {
+        addCounters(&stats[cls], gRetired[cls]);
+    }
+    for (ThreadCache* cache = gCaches ; cache ; cache = cache->next) {
+        for (int cls = 0 ; cls <= NUM_CLASSES ; cls++) {
+            uint64_t values[NUM_COUNTERS];
+            for (int i = 0 ; i < NUM_COUNTERS ; i++) {
+                values[i] = cache->counters[cls].values[i].load(std::memory_order_relaxed);
+            }
+            addCounters(&stats[cls], values);
+        }
+    }
+    pthread_mutex_unlock(&gRegistryLock);
+
+    if (perClass) {
+        memcpy(perClass, stats, sizeof(Stats) * NUM_CLASSES);
+    }
+    if (total) {
+        memset(total, 0, sizeof(*total));
+        for (int cls = 0 ; cls <= NUM_CLASSES ; cls++) {
+            total->allocs += stats[cls].allocs;
+            total->cacheHits += stats[cls].cacheHits;
+            total->listHits += stats[cls].listHits;
+            total->fresh += stats[cls].fresh;
+            total->fallbacks += stats[cls].fallbacks;
+            total->frees += stats[cls].frees;
+            total->resizesInPlace += stats[cls].resizesInPlace;
+        }
+    }
+    return true;
+}
+
+void VectorPool::dumpStats(int fd)
+{
+    Stats perClass[NUM_CLASSES];
+    Stats total;
+    if (!getStats(perClass, &total)) {
+        dprintf(fd, "VectorPool: disabled\n");
+        return;
+    }
+    dprintf(fd, "VectorPool: arena %zu bytes, %zu per class\n",
+            size_t(gArenaEnd - gArenaBase), gRegionSize);
+    dprintf(fd, "%8s %12s %8s %8s %8s %10s %12s %10s\n",
+            "block", "allocs", "cache%", "list%", "fresh%", "fallbacks", "frees", "in-place");
+    for (int cls = 0 ; cls <= NUM_CLASSES ; cls++) {
+        const Stats& s = cls < NUM_CLASSES ? perClass[cls] : total;
+        if (cls < NUM_CLASSES && !s.allocs && !s.frees) {
+            continue;
+        }
+        const double n = s.allocs ? double(s.allocs) : 1.0;
+        char block[16];
+        if (cls < NUM_CLASSES) {
+            snprintf(block, sizeof(block), "%zu", blockSize(cls));
+        } else {
+            snprintf(block, sizeof(block), "total");
+        }
+        dprintf(fd, "%8s %12llu %7.1f%% %7.1f%% %7.1f%% %10llu %12llu %10llu\n",
+                block, (unsigned long long)s.allocs,
+                100.0 * s.cacheHits / n, 100.0 * s.listHits / n, 100.0 * s.fresh / n,
+                (unsigned long long)s.fallbacks, (unsigned long long)s.frees,
+                (unsigned long long)s.resizesInPlace);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * libutils' release() and dealloc() free() the buffer, pool block or not.
+ * These replace them in the process, see initPool().
+ */
+
+int32_t SharedBuffer::release(uint32_t flags) const
+{
+    int32_t prevRefs = 1;
+    if (onlyOwner()) {
+        mRefs.store(0, std::memory_order_relaxed);
+    } else {
+        prevRefs = mRefs.fetch_sub(1, std::memory_order_release);
+    }
+    if (prevRefs == 1) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((flags & eKeepStorage) == 0) {
+            dealloc(this);
+        }
+    }
+    return prevRefs;
+}
+
+void SharedBuffer::dealloc(const SharedBuffer* released)
+{
+    if (VectorPool::owns(released)) {
+        VectorPool::dealloc(released);
+        return;
+    }
+    free(const_cast<SharedBuffer*>(released));
+}
+
+/*****************************************************************************/
+
+}; // namespace android
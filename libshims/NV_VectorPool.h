@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTOR_POOL_H
+#define NV_VECTOR_POOL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+class SharedBuffer;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Optional size-class allocator for VectorImpl storage.
+ *
+ * When VECTORIMPL_POOL is set, SharedBuffers of up to MAX_BLOCK bytes
+ * (header included) are carved out of one per-process arena, in
+ * power-of-two size classes. Freed blocks go to a per-thread cache first
+ * and only spill to the per-class global free list (under a mutex) when
+ * that cache is full, so the common alloc/free pairs never reach dlmalloc
+ * nor take a lock. Larger buffers, and every buffer while the pool is
+ * disabled, go through SharedBuffer as before.
+ *
+ * libutils' SharedBuffer::release() and dealloc() would free() a pool
+ * block, and its own VectorImpl calls them: the shim carries versions of
+ * both that hand pool blocks back to the pool, and the pool stays disabled
+ * unless the process resolves both to the shim (it's then preloaded ahead
+ * of libutils).
+ *
+ * Tunables:
+ *   VECTORIMPL_POOL            enable the pool (default off)
+ *   VECTORIMPL_POOL_ARENA      arena size, split evenly between the
+ *                              size classes (default 8m)
+ */
+class VectorPool
+{
+public:
+    enum {
+        MIN_BLOCK_SHIFT = 5,                // 32 bytes
+        MAX_BLOCK_SHIFT = 14,               // 16 KiB
+        NUM_CLASSES     = MAX_BLOCK_SHIFT - MIN_BLOCK_SHIFT + 1,
+        MAX_BLOCK       = 1 << MAX_BLOCK_SHIFT,
+    };
+
+    //! drop-in replacements for the SharedBuffer calls VectorImpl makes
+    static  SharedBuffer*   alloc(size_t size);
+    static  void            dealloc(const SharedBuffer* released);
+    static  SharedBuffer*   editResize(const SharedBuffer* buffer, size_t size);
+
+    static  bool            isEnabled();
+
+    //! true if the buffer lives in the pool arena
+    static  bool            owns(const SharedBuffer* buffer);
+
+    struct Stats {
+        uint64_t    allocs;         // allocations the pool was asked for
+        uint64_t    cacheHits;      // ...served from the thread cache
+        uint64_t    listHits;       // ...refilled from the global free list
+        uint64_t    fresh;          // ...carved out of the arena
+        uint64_t    fallbacks;      // ...too big or arena full: malloc
+        uint64_t    frees;          // blocks returned to the pool
+        uint64_t    resizesInPlace; // editResize() that kept its block
+    };
+
+    /*! per size class (index 0 is 32 bytes) and total counters, summed over
+     *  all threads. Returns false if the pool is disabled. */
+    static  bool            getStats(Stats* perClass, Stats* total);
+
+    //! writes the counters and hit rates as text
+    static  void            dumpStats(int fd);
+};
+
+}; // namespace android
+
+#endif // NV_VECTOR_POOL_H
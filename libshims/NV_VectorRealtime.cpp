@@ -0,0 +1,371 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VectorRealtime"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "NV_VectorConfig.h"
+#include "NV_VectorDump.h"
+#include "NV_VectorRealtime.h"
+#include "NV_VectorTrace.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+bool VectorRealtime::sEnabled = false;
+std::atomic<size_t> VectorRealtime::sReservations(0);
+std::atomic<uint16_t> VectorRealtime::sMaybeReserved[VectorRealtime::FILTER_SIZE];
+
+namespace {
+
+const char* const kOpNames[VectorRealtime::NUM_OPS] = {
+    "grow", "shrink", "setCapacity", "copy-on-write", "scratch"
+};
+
+// Both tables are open-addressed, and looked up without a lock. Callers
+// claim their slot with a CAS on its key, and are never removed.
+//
+// Reservations are added and dropped under gReservationLock. A slot gets
+// its key once it holds the capacity, so a lookup that finds the key finds
+// the capacity too. A dropped reservation leaves no tombstone behind: the
+// entries after it in the run move back to close the gap, so the probes
+// only ever get as long as the live entries make them. Each move copies the
+// entry first, and bumps gReservationMoves before the slot it came from is
+// reused: a lookup that ran while entries moved under it sees the count
+// change, and starts over. It never waits for the writer.
+
+const uintptr_t kEmpty = 0;
+
+struct Reservation {
+    std::atomic<uintptr_t>  vector;
+    std::atomic<size_t>     capacity;
+};
+
+Reservation gReservations[VectorRealtime::MAX_RESERVATIONS];
+pthread_mutex_t gReservationLock = PTHREAD_MUTEX_INITIALIZER;
+std::atomic<uint32_t> gReservationMoves(0);
+
+struct CallerSlot {
+    std::atomic<uintptr_t>  address;
+    std::atomic<uint64_t>   counts[VectorRealtime::NUM_OPS];
+    std::atomic<size_t>     maxBytes;
+    std::atomic<int32_t>    lastTid;
+};
+
+CallerSlot gCallers[VectorRealtime::MAX_CALLERS];
+// the callers that couldn't be found, or didn't fit
+CallerSlot gOthers;
+
+bool gAbort = false;
+
+inline size_t hashOf(uintptr_t key, size_t size) {
+    // size is a power of two: drop the alignment bits before masking
+    return ((key >> 4) ^ (key >> 12)) & (size - 1);
+}
+
+Reservation* findReservation(uintptr_t vector)
+{
+    const size_t start = hashOf(vector, VectorRealtime::MAX_RESERVATIONS);
+    for (size_t i = 0 ; i < VectorRealtime::MAX_RESERVATIONS ; i++) {
+        Reservation& r = gReservations[(start + i) & (VectorRealtime::MAX_RESERVATIONS - 1)];
+        const uintptr_t key = r.vector.load(std::memory_order_acquire);
+        if (key == vector) {
+            return &r;
+        }
+        if (key == kEmpty) {
+            break;
+        }
+    }
+    return 0;
+}
+
+// empties the slot of r, moving the entries after it back into the gap;
+// under gReservationLock
+void removeReservation(Reservation* r)
+{
+    const size_t mask = VectorRealtime::MAX_RESERVATIONS - 1;
+    size_t hole = size_t(r - gReservations);
+    for (size_t i = (hole + 1) & mask ; i != hole ; i = (i + 1) & mask) {
+        Reservation& next = gReservations[i];
+        const uintptr_t key = next.vector.load(std::memory_order_relaxed);
+        if (key == kEmpty) {
+            break;
+        }
+        // it may only move back to the hole if the hole is between its home
+        // slot and where it is
+        const size_t home = hashOf(key, VectorRealtime::MAX_RESERVATIONS);
+        if (((i - home) & mask) < ((i - hole) & mask)) {
+            continue;
+        }
+        Reservation& to = gReservations[hole];
+        to.capacity.store(next.capacity.load(std::memory_order_relaxed),
+                std::memory_order_release);
+        to.vector.store(key, std::memory_order_release);
+        gReservationMoves.fetch_add(1, std::memory_order_release);
+        hole = i;
+    }
+    gReservations[hole].vector.store(kEmpty, std::memory_order_release);
+}
+
+// the slot of caller, claimed for it if it's new, in which case *first is
+// set to true
+CallerSlot* claimCaller(uintptr_t caller, bool* first)
+{
+    *first = false;
+    if (!caller) {
+        return &gOthers;
+    }
+    const size_t start = hashOf(caller, VectorRealtime::MAX_CALLERS);
+    for (size_t i = 0 ; i < VectorRealtime::MAX_CALLERS ; i++) {
+        CallerSlot& slot = gCallers[(start + i) & (VectorRealtime::MAX_CALLERS - 1)];
+        uintptr_t key = slot.address.load(std::memory_order_relaxed);
+        if (key == kEmpty && slot.address.compare_exchange_strong(key, caller,
+                std::memory_order_relaxed)) {
+            *first = true;
+            return &slot;
+        }
+        if (key == caller) {
+            return &slot;
+        }
+    }
+    return &gOthers;
+}
+
+bool isRealtimeThread()
+{
+    int policy = sched_getscheduler(0);
+#ifdef SCHED_RESET_ON_FORK
+    if (policy > 0) {
+        policy &= ~SCHED_RESET_ON_FORK;
+    }
+#endif
+    return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+void copyCaller(VectorRealtime::Caller* caller, const CallerSlot& slot, uintptr_t address)
+{
+    caller->address = address;
+    for (int op = 0 ; op < VectorRealtime::NUM_OPS ; op++) {
+        caller->counts[op] = slot.counts[op].load(std::memory_order_relaxed);
+    }
+    caller->maxBytes = slot.maxBytes.load(std::memory_order_relaxed);
+    caller->lastTid = slot.lastTid.load(std::memory_order_relaxed);
+}
+
+void dumpRealtime()
+{
+    VectorRealtime::dumpToFile();
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+// runs when the shim is loaded, before the libraries that depend on it
+void VectorRealtime::init()
+{
+    gAbort = vectorConfigBool("VECTORIMPL_RT_ABORT", false);
+    if (!gAbort && !vectorConfigBool("VECTORIMPL_RT_CHECK", false)) {
+        return;
+    }
+    vectorDumpRegister(dumpRealtime);
+    sEnabled = true;
+}
+
+void VectorRealtime::checkSlow(Op op, size_t count, size_t itemSize)
+{
+    if (!isRealtimeThread()) {
+        return;
+    }
+
+    // the contract is broken already, the unwinding doesn't make it worse
+    const uintptr_t caller = VectorTrace::findCaller();
+    const size_t bytes = count * itemSize;
+    const pid_t tid = pid_t(syscall(__NR_gettid));
+    bool first;
+    CallerSlot* slot = claimCaller(caller, &first);
+    slot->counts[op].fetch_add(1, std::memory_order_relaxed);
+    size_t maxBytes = slot->maxBytes.load(std::memory_order_relaxed);
+    while (bytes > maxBytes && !slot->maxBytes.compare_exchange_weak(maxBytes, bytes,
+            std::memory_order_relaxed)) {
+    }
+    slot->lastTid.store(tid, std::memory_order_relaxed);
+
+    if (gAbort || first) {
+        char where[160];
+        VectorTrace::formatCaller(caller, where, sizeof(where));
+        LOG_ALWAYS_FATAL_IF(gAbort, "%s of %zu bytes on real-time thread %d, called from %s",
+                kOpNames[op], bytes, tid, where);
+        ALOGW("%s of %zu bytes on real-time thread %d, called from %s",
+                kOpNames[op], bytes, tid, where);
+    }
+}
+
+status_t VectorRealtime::setReserved(const void* vector, size_t capacity)
+{
+    const uintptr_t key = reinterpret_cast<uintptr_t>(vector);
+    std::atomic<uint16_t>& filter = sMaybeReserved[filterOf(vector)];
+    if (!capacity && !mayBeReserved(vector)) {
+        return NO_ERROR;
+    }
+    status_t err = NO_ERROR;
+    pthread_mutex_lock(&gReservationLock);
+    Reservation* r = findReservation(key);
+    if (!capacity) {
+        if (r) {
+            removeReservation(r);
+            sReservations.fetch_sub(1, std::memory_order_relaxed);
+            filter.fetch_sub(1, std::memory_order_relaxed);
+        }
+    } else if (r) {
+        r->capacity.store(capacity, std::memory_order_release);
+    } else {
+        const size_t start = hashOf(key, MAX_RESERVATIONS);
+        err = NO_MEMORY;
+        for (size_t i = 0 ; i < MAX_RESERVATIONS ; i++) {
+            Reservation& slot = gReservations[(start + i) & (MAX_RESERVATIONS - 1)];
+            if (slot.vector.load(std::memory_order_relaxed) == kEmpty) {
+                filter.fetch_add(1, std::memory_order_relaxed);
+                sReservations.fetch_add(1, std::memory_order_relaxed);
+                slot.capacity.store(capacity, std::memory_order_release);
+                slot.vector.store(key, std::memory_order_release);
+                err = NO_ERROR;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&gReservationLock);
+    ALOGW_IF(err, "can't reserve vector %p, %d of them are already", vector, MAX_RESERVATIONS);
+    return err;
+}
+
+void VectorRealtime::moveReservedSlow(const void* from, const void* to)
+{
+    // dropped first, so the table never needs a free slot more
+    const size_t capacity = findReserved(from);
+    if (capacity) {
+        setReserved(from, 0);
+    }
+    setReserved(to, capacity);
+}
+
+void VectorRealtime::swapReservedSlow(const void* a, const void* b)
+{
+    const size_t capacityA = findReserved(a);
+    const size_t capacityB = findReserved(b);
+    if (capacityA == capacityB) {
+        return;
+    }
+    if (capacityA) {
+        setReserved(a, capacityB);
+        setReserved(b, capacityA);
+    } else {
+        setReserved(b, 0);
+        setReserved(a, capacityB);
+    }
+}
+
+size_t VectorRealtime::findReserved(const void* vector)
+{
+    const uintptr_t key = reinterpret_cast<uintptr_t>(vector);
+    for (;;) {
+        const uint32_t moves = gReservationMoves.load(std::memory_order_acquire);
+        const Reservation* r = findReservation(key);
+        const size_t capacity = r ? r->capacity.load(std::memory_order_acquire) : 0;
+        if (gReservationMoves.load(std::memory_order_acquire) == moves) {
+            return capacity;
+        }
+    }
+}
+
+ssize_t VectorRealtime::getCallers(Caller* callers, size_t max)
+{
+    if (!sEnabled) {
+        return -1;
+    }
+    size_t n = 0;
+    for (size_t i = 0 ; i < MAX_CALLERS && n < max ; i++) {
+        const uintptr_t address = gCallers[i].address.load(std::memory_order_relaxed);
+        if (address != kEmpty) {
+            copyCaller(&callers[n++], gCallers[i], address);
+        }
+    }
+    if (n < max) {
+        Caller others;
+        copyCaller(&others, gOthers, 0);
+        for (int op = 0 ; op < NUM_OPS ; op++) {
+            if (others.counts[op]) {
+                callers[n++] = others;
+                break;
+            }
+        }
+    }
+    return ssize_t(n);
+}
+
+void VectorRealtime::dumpStats(int fd)
+{
+    Caller callers[MAX_CALLERS + 1];
+    const ssize_t n = getCallers(callers, MAX_CALLERS + 1);
+    if (n < 0) {
+        dprintf(fd, "VectorRealtime: disabled\n");
+        return;
+    }
+    dprintf(fd, "VectorRealtime: pid %d, %s, %zu vectors reserved\n", getpid(),
+            gAbort ? "aborting" : "recording",
+            sReservations.load(std::memory_order_relaxed));
+    dprintf(fd, "%-48s", "caller");
+    for (int op = 0 ; op < NUM_OPS ; op++) {
+        dprintf(fd, " %13s", kOpNames[op]);
+    }
+    dprintf(fd, " %10s %8s\n", "max bytes", "tid");
+    for (ssize_t i = 0 ; i < n ; i++) {
+        const Caller& c = callers[i];
+        char where[160];
+        VectorTrace::formatCaller(c.address, where, sizeof(where));
+        dprintf(fd, "%-48s", where);
+        for (int op = 0 ; op < NUM_OPS ; op++) {
+            dprintf(fd, " %13llu", (unsigned long long)c.counts[op]);
+        }
+        dprintf(fd, " %10zu %8d\n", c.maxBytes, c.lastTid);
+    }
+}
+
+status_t VectorRealtime::dumpToFile()
+{
+    if (!sEnabled) {
+        return INVALID_OPERATION;
+    }
+    const int fd = vectorDumpOpen(".rt.txt");
+    if (fd < 0) {
+        return fd;
+    }
+    dumpStats(fd);
+    close(fd);
+    return NO_ERROR;
+}
+
+}; // namespace android
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTOR_REALTIME_H
+#define NV_VECTOR_REALTIME_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/Errors.h>
+
+#include <atomic>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Checker of the real-time contract: with VECTORIMPL_RT_CHECK set, every
+ * VectorImpl operation that allocates (_grow() past the capacity, _shrink()
+ * giving memory back, setCapacity(), the copy of shared storage before an
+ * edit, and the scratch buffers of sorts and merges) looks at the
+ * scheduling policy of the calling thread. On a SCHED_FIFO or SCHED_RR
+ * thread, it is counted against the first return address outside of the
+ * shim, and logged the first time that caller shows up. With
+ * VECTORIMPL_RT_ABORT, it aborts instead, with that caller in the message
+ * and the whole stack in the tombstone.
+ *
+ * The callers are dumped to vectorimpl-<pid>.rt.txt, see NV_VectorDump.h.
+ * While the checker is off, an operation that allocates pays a test of a
+ * global flag; one that doesn't pays nothing.
+ *
+ * Vectors that a real-time thread uses are best sized ahead of time with
+ * VectorImpl::reserve(), whose capacity this class keeps track of, checker
+ * or not.
+ *
+ * Tunables:
+ *   VECTORIMPL_RT_CHECK        record allocations on real-time threads
+ *                              (default off)
+ *   VECTORIMPL_RT_ABORT        abort on them instead (default off)
+ */
+class VectorRealtime
+{
+public:
+    enum Op {
+        GROW,           // _grow() or a merge reallocating
+        SHRINK,         // _shrink() reallocating
+        SET_CAPACITY,   // setCapacity()
+        COPY_ON_WRITE,  // shared storage copied before an edit
+        SCRATCH,        // temporary buffer of a sort, merge or batch
+        NUM_OPS
+    };
+
+    static inline bool isEnabled() { return sEnabled; }
+
+    //! call before op allocates count items of itemSize bytes
+    static inline void check(Op op, size_t count, size_t itemSize) {
+        if (sEnabled) {
+            checkSlow(op, count, itemSize);
+        }
+    }
+
+    /*! keeps vector from shrinking below capacity items, or forgets about
+     *  it for 0. NO_MEMORY once too many vectors are reserved. */
+    static  status_t        setReserved(const void* vector, size_t capacity);
+
+    //! capacity vector was reserved with, 0 if none
+    static inline size_t reservedCapacity(const void* vector) {
+        return mayBeReserved(vector) ? findReserved(vector) : 0;
+    }
+
+    /*! gives to the reservation of from, or takes its own away if from has
+     *  none, when from's storage moves to it */
+    static inline void moveReserved(const void* from, const void* to) {
+        if (mayBeReserved(from) || mayBeReserved(to)) {
+            moveReservedSlow(from, to);
+        }
+    }
+
+    //! exchanges the reservations of a and b, when they swap storage
+    static inline void swapReserved(const void* a, const void* b) {
+        if (mayBeReserved(a) || mayBeReserved(b)) {
+            swapReservedSlow(a, b);
+        }
+    }
+
+    enum {
+        MAX_RESERVATIONS    = 256,
+        MAX_CALLERS         = 128,
+    };
+
+    struct Caller {
+        uintptr_t   address;            // 0 for the unknown or untracked ones
+        uint64_t    counts[NUM_OPS];
+        size_t      maxBytes;           // largest allocation
+        pid_t       lastTid;
+    };
+
+    /*! copies up to max callers seen allocating on a real-time thread,
+     *  returns how many. Returns -1 if the checker is disabled. */
+    static  ssize_t         getCallers(Caller* callers, size_t max);
+
+    //! writes the callers as text
+    static  void            dumpStats(int fd);
+
+    //! writes the callers to the dump file
+    static  status_t        dumpToFile();
+
+private:
+    /*
+     * Every VectorImpl is constructed, destroyed and moved past the
+     * reservations, so it checks two words first: the count of
+     * reservations, and the count of those whose vector's address falls in
+     * the same of FILTER_SIZE buckets, which only a vector at a colliding
+     * address has to go past to the table.
+     */
+    enum {
+        FILTER_SIZE         = 1024,
+    };
+
+    static inline size_t filterOf(const void* vector) {
+        const uintptr_t key = reinterpret_cast<uintptr_t>(vector);
+        return ((key >> 4) ^ (key >> 14)) & (FILTER_SIZE - 1);
+    }
+
+    static inline bool mayBeReserved(const void* vector) {
+        return sReservations.load(std::memory_order_relaxed) &&
+                sMaybeReserved[filterOf(vector)].load(std::memory_order_relaxed);
+    }
+
+    static  void            init() __attribute__((constructor));
+    static  void            checkSlow(Op op, size_t count, size_t itemSize);
+    static  size_t          findReserved(const void* vector);
+    static  void            moveReservedSlow(const void* from, const void* to);
+    static  void            swapReservedSlow(const void* a, const void* b);
+
+    static  bool                    sEnabled;
+    static  std::atomic<size_t>     sReservations;
+    static  std::atomic<uint16_t>   sMaybeReserved[FILTER_SIZE];
+};
+
+}; // namespace android
+
+#endif // NV_VECTOR_REALTIME_H
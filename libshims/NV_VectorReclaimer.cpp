@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VectorReclaimer"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <atomic>
+
+#include <log/log.h>
+#include <utils/SharedBuffer.h>
+
+#include "NV_VectorConfig.h"
+#include "NV_VectorPool.h"
+#include "NV_VectorReclaimer.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+namespace {
+
+const size_t kDefaultMinBytes = 64 * 1024;
+const size_t kDefaultMaxBytes = 4 * 1024 * 1024;
+
+// ANDROID_PRIORITY_BACKGROUND
+const int kReclaimerNice = 10;
+
+// a queued buffer, the link written over its dead items
+struct Node {
+    Node*   next;
+};
+
+bool gEnabled = false;
+size_t gMinBytes = 0;
+size_t gMaxBytes = 0;
+
+// only the thread that forked survives in the child: no more deferring there
+std::atomic<bool> gRunning(false);
+
+std::atomic<Node*> gQueue(nullptr);
+std::atomic<size_t> gPendingBytes(0);
+std::atomic<uint64_t> gDeferred(0);
+std::atomic<uint64_t> gReclaimed(0);
+std::atomic<uint64_t> gOverflows(0);
+
+sem_t gWakeup;
+
+// held while a batch taken off the queue is being freed, so drain() can
+// wait for the one the reclaimer is working on
+pthread_mutex_t gReclaimLock = PTHREAD_MUTEX_INITIALIZER;
+
+inline SharedBuffer* bufferOf(Node* node) {
+    return SharedBuffer::bufferFromData(node);
+}
+
+// frees a batch taken off the queue. Called with gReclaimLock held.
+void reclaim(Node* node)
+{
+    while (node) {
+        Node* next = node->next;
+        const SharedBuffer* sb = bufferOf(node);
+        const size_t bytes = sb->size();
+        VectorPool::dealloc(sb);
+        gPendingBytes.fetch_sub(bytes, std::memory_order_relaxed);
+        gReclaimed.fetch_add(1, std::memory_order_relaxed);
+        node = next;
+    }
+}
+
+void* reclaimerThread(void*)
+{
+    // the nice value is per thread on Linux
+    setpriority(PRIO_PROCESS, 0, kReclaimerNice);
+    for (;;) {
+        while (sem_wait(&gWakeup) && errno == EINTR) {
+        }
+        pthread_mutex_lock(&gReclaimLock);
+        reclaim(gQueue.exchange(nullptr, std::memory_order_acquire));
+        pthread_mutex_unlock(&gReclaimLock);
+    }
+    return NULL;
+}
+
+void onForkChild()
+{
+    gRunning.store(false, std::memory_order_relaxed);
+}
+
+bool startReclaimer()
+{
+    // the reclaimer must not take any of the process' signals, nor inherit
+    // the real-time policy of whoever loaded the shim
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    pthread_attr_setschedparam(&attr, &param);
+    pthread_t thread;
+    const int err = pthread_create(&thread, &attr, reclaimerThread, NULL);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (err) {
+        ALOGE("can't start the reclaimer: %s", strerror(err));
+        return false;
+    }
+    return true;
+}
+
+// runs when the shim is loaded, before the libraries that depend on it
+__attribute__((constructor))
+void loadReclaimer()
+{
+    if (!vectorConfigBool("VECTORIMPL_RECLAIM", false)) {
+        return;
+    }
+    gMinBytes = vectorConfigSize("VECTORIMPL_RECLAIM_MIN", kDefaultMinBytes);
+    gMaxBytes = vectorConfigSize("VECTORIMPL_RECLAIM_MAX", kDefaultMaxBytes);
+    if (gMinBytes < sizeof(Node)) {
+        // the link has to fit in the buffer
+        gMinBytes = sizeof(Node);
+    }
+    if (sem_init(&gWakeup, 0, 0)) {
+        ALOGE("can't create the reclaimer semaphore: %s, reclaimer disabled",
+                strerror(errno));
+        return;
+    }
+    if (!startReclaimer()) {
+        return;
+    }
+    pthread_atfork(NULL, NULL, onForkChild);
+    gEnabled = true;
+    gRunning.store(true, std::memory_order_relaxed);
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+void VectorReclaimer::dealloc(const SharedBuffer* released)
+{
+    const size_t bytes = released->size();
+    if (!wants(bytes)) {
+        VectorPool::dealloc(released);
+        return;
+    }
+    if (gPendingBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes > gMaxBytes) {
+        gPendingBytes.fetch_sub(bytes, std::memory_order_relaxed);
+        gOverflows.fetch_add(1, std::memory_order_relaxed);
+        VectorPool::dealloc(released);
+        return;
+    }
+
+    Node* node = static_cast<Node*>(const_cast<void*>(released->data()));
+    node->next = gQueue.load(std::memory_order_relaxed);
+    while (!gQueue.compare_exchange_weak(node->next, node,
+            std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    gDeferred.fetch_add(1, std::memory_order_relaxed);
+    if (!node->next) {
+        // whoever queued the others already woke the reclaimer up, and it
+        // takes the whole list at once
+        sem_post(&gWakeup);
+    }
+}
+
+bool VectorReclaimer::wants(size_t bytes)
+{
+    return bytes >= gMinBytes && gRunning.load(std::memory_order_relaxed);
+}
+
+void VectorReclaimer::drain()
+{
+    if (!gEnabled) {
+        return;
+    }
+    pthread_mutex_lock(&gReclaimLock);
+    reclaim(gQueue.exchange(nullptr, std::memory_order_acquire));
+    pthread_mutex_unlock(&gReclaimLock);
+}
+
+bool VectorReclaimer::isEnabled()
+{
+    return gEnabled;
+}
+
+bool VectorReclaimer::getStats(Stats* stats)
+{
+    if (!gEnabled) {
+        return false;
+    }
+    stats->deferred = gDeferred.load(std::memory_order_relaxed);
+    stats->reclaimed = gReclaimed.load(std::memory_order_relaxed);
+    stats->overflows = gOverflows.load(std::memory_order_relaxed);
+    stats->pendingBytes = gPendingBytes.load(std::memory_order_relaxed);
+    return true;
+}
+
+void VectorReclaimer::dumpStats(int fd)
+{
+    Stats stats;
+    if (!getStats(&stats)) {
+        dprintf(fd, "VectorReclaimer: disabled\n");
+        return;
+    }
+    dprintf(fd, "VectorReclaimer: buffers of %zu bytes and up, %zu bytes queued at most\n",
+            gMinBytes, gMaxBytes);
+    dprintf(fd, "%12s %12s %12s %14s\n", "deferred", "reclaimed", "overflows", "pending");
+    dprintf(fd, "%12llu %12llu %12llu %14zu\n",
+            (unsigned long long)stats.deferred, (unsigned long long)stats.reclaimed,
+            (unsigned long long)stats.overflows, stats.pendingBytes);
+}
+
+}; // namespace android
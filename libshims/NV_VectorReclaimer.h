@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTOR_RECLAIMER_H
+#define NV_VECTOR_RECLAIMER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+class SharedBuffer;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Optional deferred freeing of large VectorImpl storage.
+ *
+ * When the last reference to a big buffer goes, freeing it can mean a
+ * munmap() and its TLB shootdown on whatever thread let go of it, which
+ * may well be an audio thread. With VECTORIMPL_RECLAIM set, buffers of at
+ * least VECTORIMPL_RECLAIM_MIN bytes are pushed on a lock-free list
+ * instead, and a background thread at a low, non real-time priority
+ * frees them. Pushing neither allocates nor takes a lock; the link lives
+ * in the released buffer itself.
+ *
+ * Only the freeing is deferred, so only buffers with nothing left to
+ * destroy qualify: those of vectors with HAS_TRIVIAL_DTOR, and those whose
+ * items were moved out. do_destroy() belongs to a vector that may be gone
+ * by the time the reclaimer runs, so the releasing thread has to destroy
+ * the items of any other buffer itself, and it frees that buffer right
+ * away too.
+ *
+ * Tunables:
+ *   VECTORIMPL_RECLAIM         enable the reclaimer (default off)
+ *   VECTORIMPL_RECLAIM_MIN     smallest buffer deferred (default 64k)
+ *   VECTORIMPL_RECLAIM_MAX     bytes waiting for the reclaimer at most;
+ *                              past that, buffers are freed right away
+ *                              (default 4m)
+ */
+class VectorReclaimer
+{
+public:
+    /*! frees a buffer released with eKeepStorage, with no items left to
+     *  destroy: later on the reclaimer thread if it qualifies, right away
+     *  through VectorPool::dealloc() otherwise */
+    static  void            dealloc(const SharedBuffer* released);
+
+    //! true if dealloc() would hand a buffer of that size to the reclaimer
+    static  bool            wants(size_t bytes);
+
+    /*! frees everything queued so far on the calling thread, and returns
+     *  once the reclaimer is done with what it had taken too */
+    static  void            drain();
+
+    static  bool            isEnabled();
+
+    struct Stats {
+        uint64_t    deferred;       // buffers queued for the reclaimer
+        uint64_t    reclaimed;      // ...and freed since
+        uint64_t    overflows;      // freed right away, the queue being full
+        size_t      pendingBytes;   // queued and not freed yet
+    };
+
+    //! returns false if the reclaimer is disabled
+    static  bool            getStats(Stats* stats);
+
+    //! writes the counters as text
+    static  void            dumpStats(int fd);
+};
+
+}; // namespace android
+
+#endif // NV_VECTOR_RECLAIMER_H
@@ -0,0 +1,620 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VectorSlack"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <new>
+
+#include <log/log.h>
+#include <utils/SharedBuffer.h>
+
+#include "NV_VectorConfig.h"
+#include "NV_VectorDump.h"
+#include "NV_VectorImpl.h"
+#include "NV_VectorRealtime.h"
+#include "NV_VectorSlack.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+bool VectorSlack::sEnabled = false;
+
+namespace {
+
+const size_t kDefaultMinBytes = 16 * 1024;
+const size_t kDefaultEntries = 1024;
+const size_t kMaxEntries = 1 << 16;
+
+const char kDefaultMemcg[] = "/dev/memcg";
+
+// pages looked up per mincore() call
+const size_t kResidencyBatch = 256;
+
+// returned by enter()
+const ssize_t kUntracked = -1;
+
+#if defined(__LP64__)
+#define MANGLED_SIZE_T "m"
+#else
+#define MANGLED_SIZE_T "j"
+#endif
+
+/*
+ * The registry only knows what the calls of the shim tell it: a buffer that
+ * libutils' own VectorImpl appended to, reallocated or freed behind its
+ * back would have live items dropped, or freed memory madvise()d. So it
+ * only runs where the process resolves what grows, shrinks, replaces and
+ * frees Vector storage to the shim.
+ */
+const char* const kStorageSymbols[] = {
+    "_ZN7android10VectorImpl5_growE" MANGLED_SIZE_T MANGLED_SIZE_T,
+    "_ZN7android10VectorImpl7_shrinkE" MANGLED_SIZE_T MANGLED_SIZE_T,
+    "_ZN7android10VectorImpl13editArrayImplEv",
+    "_ZN7android10VectorImpl11setCapacityE" MANGLED_SIZE_T,
+    "_ZN7android10VectorImpl15release_storageEv",
+    "_ZNK7android12SharedBuffer7releaseEj",
+    "_ZN7android12SharedBuffer7deallocEPKS0_",
+};
+
+const uintptr_t kEmpty = 0;
+const uintptr_t kRemoved = 1;
+const uintptr_t kClaimed = 2;
+
+/*
+ * A slot is claimed with a marker by a CAS on its key, the data of the
+ * buffer, filled in, and only then given its key. It's given back by a call
+ * that replaced the buffer of its vector, or by forget() right before the
+ * buffer is freed.
+ *
+ * Its state counts the calls at work on the buffer, one per scope, with
+ * TRIMMING set while trim() looks at it. trim() only takes a slot nobody
+ * uses, and only for a whole page of slack to check, so the calls have
+ * precedence: they never wait for trim(), unless they come in during its
+ * work on that very buffer. They then sleep on gTrimLock, which trim()
+ * holds for the work on each slot: spinning instead would last forever on
+ * a SCHED_FIFO thread that shares its CPU with the trim thread.
+ */
+const uint32_t TRIMMING = 1;
+const uint32_t kOneCall = 2;
+
+struct Slot {
+    std::atomic<uintptr_t>  storage;
+    std::atomic<uint32_t>   state;
+    std::atomic<size_t>     used;       // bytes trim() leaves alone
+    std::atomic<size_t>     size;       // of the buffer
+};
+
+// the used bytes of a slot nobody published any for yet: all of them
+const size_t kAllUsed = SIZE_MAX;
+
+Slot* gSlots = 0;
+size_t gMask = 0;
+size_t gMinBytes = 0;
+uintptr_t gPageSize = 0;
+
+// scope depth of the calling thread: only the outermost scope registers
+// a buffer, or trim() could get to it while an outer call is at work
+pthread_key_t gDepthKey;
+
+std::atomic<size_t> gBuffers(0);
+std::atomic<uint64_t> gTrims(0);
+std::atomic<uint64_t> gTrimmedBytes(0);
+std::atomic<uint64_t> gOverflows(0);
+
+// one scan of the table at a time
+pthread_mutex_t gScanLock = PTHREAD_MUTEX_INITIALIZER;
+// held by trim() while it works on a slot, see above
+pthread_mutex_t gTrimLock = PTHREAD_MUTEX_INITIALIZER;
+
+// written by the signal handler, read with the pressure events by the
+// trim thread
+int gSignalEvent = -1;
+int gPressureEvent = -1;
+
+inline size_t hashOf(uintptr_t key) {
+    return ((key >> 4) ^ (key >> 12)) & gMask;
+}
+
+ssize_t findSlot(uintptr_t key)
+{
+    const size_t start = hashOf(key);
+    for (size_t i = 0 ; i <= gMask ; i++) {
+        const size_t index = (start + i) & gMask;
+        const uintptr_t current = gSlots[index].storage.load(std::memory_order_relaxed);
+        if (current == key) {
+            return ssize_t(index);
+        }
+        if (current == kEmpty) {
+            break;
+        }
+    }
+    return -1;
+}
+
+// publishes what trim() may look at, which it can't while slot is in use
+inline void publishSlot(Slot& slot, size_t used, size_t size)
+{
+    slot.used.store(used, std::memory_order_relaxed);
+    slot.size.store(size, std::memory_order_relaxed);
+}
+
+// drops the slot of the buffer at key, if it still has it
+void removeSlot(Slot& slot, uintptr_t key)
+{
+    if (slot.storage.load(std::memory_order_relaxed) == key) {
+        slot.used.store(kAllUsed, std::memory_order_relaxed);
+        slot.storage.store(kRemoved, std::memory_order_release);
+        gBuffers.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+// a new slot for the buffer at key, which trim() may take right away
+bool insertSlot(uintptr_t key, size_t used, size_t size)
+{
+    const size_t start = hashOf(key);
+    for (size_t i = 0 ; i <= gMask ; i++) {
+        Slot& slot = gSlots[(start + i) & gMask];
+        uintptr_t current = slot.storage.load(std::memory_order_relaxed);
+        while (current == kEmpty || current == kRemoved) {
+            if (slot.storage.compare_exchange_weak(current, kClaimed,
+                    std::memory_order_relaxed, std::memory_order_relaxed)) {
+                publishSlot(slot, used, size);
+                slot.storage.store(key, std::memory_order_release);
+                gBuffers.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// counts a call in slot, if it still belongs to the buffer at key
+bool useSlot(Slot& slot, uintptr_t key)
+{
+    if (slot.state.fetch_add(kOneCall, std::memory_order_acquire) & TRIMMING) {
+        // trim() is done with the buffer once it lets go of the lock
+        pthread_mutex_lock(&gTrimLock);
+        pthread_mutex_unlock(&gTrimLock);
+    }
+    if (slot.storage.load(std::memory_order_relaxed) != key) {
+        // given back, and maybe claimed again, since it was looked up
+        slot.state.fetch_sub(kOneCall, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+inline intptr_t addDepth(intptr_t delta) {
+    const intptr_t depth = intptr_t(pthread_getspecific(gDepthKey)) + delta;
+    pthread_setspecific(gDepthKey, reinterpret_cast<void*>(depth));
+    return depth;
+}
+
+// bytes of [start, start + length) in memory, both page aligned
+size_t residentBytes(uintptr_t start, size_t length)
+{
+    size_t resident = 0;
+    unsigned char pages[kResidencyBatch];
+    while (length) {
+        const size_t n = length / gPageSize < kResidencyBatch ?
+                length / gPageSize : kResidencyBatch;
+        if (mincore(reinterpret_cast<void*>(start), n * gPageSize, pages)) {
+            // can't tell: assume the worst
+            return resident + length;
+        }
+        for (size_t i = 0 ; i < n ; i++) {
+            if (pages[i] & 1) {
+                resident += gPageSize;
+            }
+        }
+        start += n * gPageSize;
+        length -= n * gPageSize;
+    }
+    return resident;
+}
+
+void slackSignalHandler(int)
+{
+    const int savedErrno = errno;
+    const uint64_t one = 1;
+    if (write(gSignalEvent, &one, sizeof(one)) < 0) {
+        // the counter is saturated: a trim is pending already
+    }
+    errno = savedErrno;
+}
+
+void* trimThread(void*)
+{
+    struct pollfd fds[2];
+    nfds_t nfds = 0;
+    if (gSignalEvent >= 0) {
+        fds[nfds].fd = gSignalEvent;
+        fds[nfds++].events = POLLIN;
+    }
+    if (gPressureEvent >= 0) {
+        fds[nfds].fd = gPressureEvent;
+        fds[nfds++].events = POLLIN;
+    }
+    for (;;) {
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("poll failed: %s, no more trims", strerror(errno));
+            break;
+        }
+        bool wanted = false;
+        for (nfds_t i = 0 ; i < nfds ; i++) {
+            uint64_t events;
+            if ((fds[i].revents & POLLIN) && read(fds[i].fd, &events, sizeof(events)) > 0) {
+                wanted = true;
+            }
+        }
+        if (wanted) {
+            const size_t trimmed = VectorSlack::trim();
+            ALOGI("trimmed %zu bytes of vector slack", trimmed);
+        }
+    }
+    return 0;
+}
+
+// hooks signo, unless the process already handles it
+bool installTrimSignal(int signo)
+{
+    struct sigaction old;
+    if (sigaction(signo, NULL, &old) ||
+            (old.sa_handler != SIG_DFL && old.sa_handler != SIG_IGN)) {
+        ALOGW("signal %d is taken, no trims on signal", signo);
+        return false;
+    }
+    gSignalEvent = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (gSignalEvent < 0) {
+        ALOGW("can't create the trim event: %s", strerror(errno));
+        return false;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = slackSignalHandler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(signo, &sa, NULL);
+    return true;
+}
+
+// registers for the vmpressure events of the memory cgroup, the way lmkd
+// does
+bool watchPressure(const char* memcg, const char* level)
+{
+    if (strcmp(level, "low") && strcmp(level, "medium") && strcmp(level, "critical")) {
+        ALOGW("VECTORIMPL_SLACK_PRESSURE=%s isn't a pressure level", level);
+        return false;
+    }
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/memory.pressure_level", memcg);
+    // stays open for as long as the events are wanted
+    const int pressure = open(path, O_RDONLY | O_CLOEXEC);
+    if (pressure < 0) {
+        ALOGW("can't open %s: %s", path, strerror(errno));
+        return false;
+    }
+    snprintf(path, sizeof(path), "%s/cgroup.event_control", memcg);
+    const int control = open(path, O_WRONLY | O_CLOEXEC);
+    const int event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (control >= 0 && event >= 0) {
+        char line[64];
+        const int n = snprintf(line, sizeof(line), "%d %d %s", event, pressure, level);
+        if (write(control, line, n) == n) {
+            close(control);
+            gPressureEvent = event;
+            return true;
+        }
+    }
+    ALOGW("can't watch the memory pressure of %s: %s", memcg, strerror(errno));
+    if (event >= 0) close(event);
+    if (control >= 0) close(control);
+    close(pressure);
+    return false;
+}
+
+void startTrimThread()
+{
+    // the trim thread must not take any of the process' signals
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    const int err = pthread_create(&thread, &attr, trimThread, NULL);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (err) {
+        ALOGW("can't start the trim thread: %s", strerror(err));
+    }
+}
+
+void dumpSlack()
+{
+    VectorSlack::dumpToFile();
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+// runs when the shim is loaded, before the libraries that depend on it
+void VectorSlack::init()
+{
+    if (!vectorConfigBool("VECTORIMPL_SLACK", false)) {
+        return;
+    }
+    if (!vectorShimResolves("slack registry", kStorageSymbols,
+            sizeof(kStorageSymbols) / sizeof(kStorageSymbols[0]))) {
+        return;
+    }
+    size_t entries = vectorConfigSize("VECTORIMPL_SLACK_ENTRIES", kDefaultEntries);
+    if (entries < 2 || entries > kMaxEntries) {
+        ALOGW("VECTORIMPL_SLACK_ENTRIES=%zu out of [2, %zu], using %zu",
+                entries, kMaxEntries, kDefaultEntries);
+        entries = kDefaultEntries;
+    }
+    entries = size_t(1) << (sizeof(unsigned long) * 8 - __builtin_clzl(entries - 1));
+
+    gPageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+    gMinBytes = vectorConfigSize("VECTORIMPL_SLACK_MIN", kDefaultMinBytes);
+    if (gMinBytes < gPageSize) {
+        // nothing smaller can have a whole page to give back
+        gMinBytes = gPageSize;
+    }
+    if (pthread_key_create(&gDepthKey, NULL)) {
+        ALOGE("can't create the slack key, registry disabled");
+        return;
+    }
+    gSlots = new (std::nothrow) Slot[entries]();
+    if (!gSlots) {
+        ALOGE("can't allocate %zu slack entries, registry disabled", entries);
+        return;
+    }
+    gMask = entries - 1;
+    for (size_t i = 0 ; i < entries ; i++) {
+        gSlots[i].used.store(kAllUsed, std::memory_order_relaxed);
+    }
+
+    const size_t signo = vectorConfigSize("VECTORIMPL_SLACK_SIGNAL", 0);
+    if (signo >= NSIG) {
+        ALOGW("VECTORIMPL_SLACK_SIGNAL=%zu isn't a signal", signo);
+    } else if (signo) {
+        installTrimSignal(int(signo));
+    }
+    char level[16];
+    vectorConfigString("VECTORIMPL_SLACK_PRESSURE", "", level, sizeof(level));
+    if (level[0]) {
+        char memcg[PATH_MAX - 64];
+        vectorConfigString("VECTORIMPL_SLACK_MEMCG", kDefaultMemcg, memcg, sizeof(memcg));
+        watchPressure(memcg, level);
+    }
+    if (gSignalEvent >= 0 || gPressureEvent >= 0) {
+        startTrimThread();
+    }
+
+    vectorDumpRegister(dumpSlack);
+    sEnabled = true;
+}
+
+void VectorSlack::enter(const VectorImpl* vector, Call* call)
+{
+    addDepth(1);
+    call->storage = reinterpret_cast<uintptr_t>(vector->mStorage);
+    call->slot = call->storage ? findSlot(call->storage) : kUntracked;
+    if (call->slot >= 0 && !useSlot(gSlots[call->slot], call->storage)) {
+        call->slot = kUntracked;
+    }
+    if (call->slot >= 0) {
+        // the other owners can't free the buffer before this call is over
+        call->shared = !SharedBuffer::bufferFromData(vector->mStorage)->onlyOwner();
+    }
+}
+
+void VectorSlack::leave(const VectorImpl* vector, const Call& call)
+{
+    const intptr_t depth = addDepth(-1);
+    const uintptr_t storage = reinterpret_cast<uintptr_t>(vector->mStorage);
+    const size_t bytes = storage ?
+            SharedBuffer::bufferFromData(vector->mStorage)->size() : 0;
+    // the pages of a reserved vector are all meant to stay
+    const size_t used = VectorRealtime::reservedCapacity(vector) ?
+            bytes : vector->mCount * vector->mItemSize;
+    bool tracked = false;
+    if (call.slot >= 0) {
+        Slot& slot = gSlots[call.slot];
+        if (slot.storage.load(std::memory_order_relaxed) != call.storage) {
+            // forgotten during the call
+        } else if (storage == call.storage) {
+            publishSlot(slot, used, bytes);
+            tracked = true;
+        } else if (!call.shared) {
+            // resized: whoever holds the buffer now registers it again on
+            // its next call
+            removeSlot(slot, call.storage);
+        }
+        // else this vector let go of a buffer that lives on with its other
+        // owners, whose items are the ones published already: had it
+        // been freed, forget() would have dropped the slot
+        slot.state.fetch_sub(kOneCall, std::memory_order_release);
+    }
+    // only the outermost call registers a buffer, or trim() could get to
+    // it while an outer call is at work
+    if (!tracked && bytes >= gMinBytes && !depth && findSlot(storage) < 0) {
+        if (!insertSlot(storage, used, bytes)) {
+            gOverflows.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void VectorSlack::forgetSlow(const void* storage)
+{
+    const uintptr_t key = reinterpret_cast<uintptr_t>(storage);
+    if (SharedBuffer::bufferFromData(storage)->size() < gMinBytes) {
+        return;
+    }
+    const ssize_t index = findSlot(key);
+    if (index >= 0 && useSlot(gSlots[index], key)) {
+        removeSlot(gSlots[index], key);
+        gSlots[index].state.fetch_sub(kOneCall, std::memory_order_release);
+    }
+}
+
+size_t VectorSlack::scan(Stats* stats, bool trim)
+{
+    memset(stats, 0, sizeof(*stats));
+    size_t trimmed = 0;
+    pthread_mutex_lock(&gScanLock);
+    for (size_t i = 0 ; i <= gMask ; i++) {
+        Slot& slot = gSlots[i];
+        uintptr_t data = slot.storage.load(std::memory_order_acquire);
+        if (data <= kClaimed) {
+            continue;
+        }
+        // a slot claimed but not published yet has kAllUsed
+        size_t size = slot.size.load(std::memory_order_relaxed);
+        size_t used = slot.used.load(std::memory_order_relaxed);
+        if (used > size) {
+            used = size;
+        }
+        uintptr_t start = (data + used + gPageSize - 1) & ~(gPageSize - 1);
+        uintptr_t end = (data + size) & ~(gPageSize - 1);
+        if (end <= start) {
+            // not a page of slack, reserved vectors among them: nothing to
+            // look at, and no reason to get in the way of the calls
+            stats->buffers++;
+            stats->usedBytes += used;
+            stats->capacityBytes += size;
+            continue;
+        }
+
+        pthread_mutex_lock(&gTrimLock);
+        uint32_t state = 0;
+        if (!slot.state.compare_exchange_strong(state, TRIMMING,
+                std::memory_order_acquire, std::memory_order_relaxed)) {
+            // busy: not idle, by definition
+            pthread_mutex_unlock(&gTrimLock);
+            continue;
+        }
+        // the slot may have changed hands before it was taken; once it is,
+        // nobody can free the buffer: every free goes through the shim, see
+        // kStorageSymbols
+        data = slot.storage.load(std::memory_order_acquire);
+        if (data > kClaimed) {
+            const SharedBuffer* sb = SharedBuffer::bufferFromData(reinterpret_cast<void*>(data));
+            size = slot.size.load(std::memory_order_relaxed);
+            used = slot.used.load(std::memory_order_relaxed);
+            if (used > size) {
+                used = size;
+            }
+            start = (data + used + gPageSize - 1) & ~(gPageSize - 1);
+            end = (data + size) & ~(gPageSize - 1);
+            size_t resident = end > start ? residentBytes(start, end - start) : 0;
+            if (trim && resident && sb->onlyOwner() &&
+                    !madvise(reinterpret_cast<void*>(start), end - start, MADV_DONTNEED)) {
+                trimmed += resident;
+                resident = 0;
+            }
+            stats->buffers++;
+            stats->usedBytes += used;
+            stats->capacityBytes += size;
+            stats->residentSlack += resident;
+        }
+        slot.state.fetch_and(~TRIMMING, std::memory_order_release);
+        pthread_mutex_unlock(&gTrimLock);
+    }
+    if (trim) {
+        gTrims.fetch_add(1, std::memory_order_relaxed);
+        gTrimmedBytes.fetch_add(trimmed, std::memory_order_relaxed);
+    }
+    stats->trims = gTrims.load(std::memory_order_relaxed);
+    stats->trimmedBytes = gTrimmedBytes.load(std::memory_order_relaxed);
+    stats->overflows = gOverflows.load(std::memory_order_relaxed);
+    pthread_mutex_unlock(&gScanLock);
+    return trimmed;
+}
+
+bool VectorSlack::getStats(Stats* stats)
+{
+    if (!sEnabled) {
+        return false;
+    }
+    scan(stats, false);
+    return true;
+}
+
+size_t VectorSlack::trim()
+{
+    if (!sEnabled) {
+        return 0;
+    }
+    Stats stats;
+    return scan(&stats, true);
+}
+
+void VectorSlack::dumpStats(int fd)
+{
+    Stats stats;
+    if (!getStats(&stats)) {
+        dprintf(fd, "VectorSlack: disabled\n");
+        return;
+    }
+    dprintf(fd, "VectorSlack: pid %d, storage of %zu bytes and up, %zu entries\n",
+            getpid(), gMinBytes, gMask + 1);
+    dprintf(fd, "%10s %14s %14s %14s %10s %14s %10s\n", "buffers", "used", "capacity",
+            "resident slack", "trims", "trimmed", "overflows");
+    dprintf(fd, "%10zu %14zu %14zu %14zu %10llu %14llu %10llu\n", stats.buffers,
+            stats.usedBytes, stats.capacityBytes, stats.residentSlack,
+            (unsigned long long)stats.trims, (unsigned long long)stats.trimmedBytes,
+            (unsigned long long)stats.overflows);
+}
+
+status_t VectorSlack::dumpToFile()
+{
+    if (!sEnabled) {
+        return INVALID_OPERATION;
+    }
+    const int fd = vectorDumpOpen(".slack.txt");
+    if (fd < 0) {
+        return fd;
+    }
+    dumpStats(fd);
+    close(fd);
+    return NO_ERROR;
+}
+
+}; // namespace android
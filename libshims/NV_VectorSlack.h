@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTOR_SLACK_H
+#define NV_VECTOR_SLACK_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+class VectorImpl;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Registry of the big VectorImpl storage, and trimming of its slack.
+ *
+ * With VECTORIMPL_SLACK set, every storage buffer of VECTORIMPL_SLACK_MIN
+ * bytes or more gets a slot in a process-wide table, holding how many of
+ * its bytes the items use, until it's freed or no longer that big. The
+ * slots are keyed by buffer rather than by vector, since blobs move
+ * vectors around with memcpy() (Vector<Vector<T> > is trivially movable).
+ * The table tells how much of the storage is used and how much is only
+ * capacity, and trim() returns the pages of the unused capacity to the
+ * kernel, with madvise(MADV_DONTNEED).
+ *
+ * Storage can't be moved from under a vector by another thread: blob code
+ * reads it through inlined accessors. So a trim leaves the capacity alone
+ * and only drops the physical pages past the last item; they come back,
+ * zero-filled, when the vector grows into them. Only idle buffers are
+ * trimmed: every call that may grow into, free or replace a buffer counts
+ * itself in its slot, and trim() skips the slots in use. The calls never
+ * wait for trim(), except one that comes in while trim() checks or drops
+ * the pages of its own buffer, and that one sleeps rather than spins. The
+ * buffers are forgotten before they're freed. Buffers shared by
+ * several vectors, and those of vectors reserved with VectorImpl::reserve()
+ * (their pages would fault back in on a real-time thread), are skipped.
+ *
+ * All of this assumes the shim sees every change to the buffers, which
+ * only holds where it is preloaded ahead of libutils: where LD_SHIM_LIBS
+ * only binds it to a few libraries, libutils' VectorImpl works on the
+ * same buffers behind its back, and the registry stays disabled.
+ *
+ * Besides direct calls, a thread of the shim trims when the process gets
+ * VECTORIMPL_SLACK_SIGNAL, and when the memory cgroup reports pressure of
+ * the VECTORIMPL_SLACK_PRESSURE level. The totals are dumped to
+ * vectorimpl-<pid>.slack.txt, see NV_VectorDump.h.
+ *
+ * Tunables:
+ *   VECTORIMPL_SLACK           enable the registry (default off)
+ *   VECTORIMPL_SLACK_MIN       smallest storage tracked, in bytes
+ *                              (default 16k)
+ *   VECTORIMPL_SLACK_ENTRIES   buffers tracked at most, rounded up to a
+ *                              power of two (default 1024)
+ *   VECTORIMPL_SLACK_SIGNAL    signal that trims (default 0: none)
+ *   VECTORIMPL_SLACK_PRESSURE  "low", "medium" or "critical": trim on
+ *                              memory pressure of that level (default none)
+ *   VECTORIMPL_SLACK_MEMCG     memory cgroup to watch (default /dev/memcg)
+ */
+class VectorSlack
+{
+public:
+    static inline bool isEnabled() { return sEnabled; }
+
+    struct Stats {
+        size_t      buffers;        // tracked right now
+        size_t      usedBytes;      // ...used by items
+        size_t      capacityBytes;  // ...their storage
+        size_t      residentSlack;  // whole pages of unused capacity that
+                                    // are still in memory
+        uint64_t    trims;
+        uint64_t    trimmedBytes;   // returned by all the trims so far
+        uint64_t    overflows;      // buffers that didn't fit in the table
+    };
+
+    //! returns false if the registry is disabled
+    static  bool            getStats(Stats* stats);
+
+    /*! drops the pages past the last item of every idle, uniquely owned
+     *  buffer tracked, and returns how many bytes were in memory */
+    static  size_t          trim();
+
+    //! writes the totals as text
+    static  void            dumpStats(int fd);
+
+    //! writes the totals to the dump file
+    static  status_t        dumpToFile();
+
+    //! call before freeing the storage of a vector
+    static inline void forget(const void* storage) {
+        if (sEnabled) {
+            forgetSlow(storage);
+        }
+    }
+
+private:
+    friend class VectorSlackScope;
+
+    // a call on a vector, see VectorSlackScope
+    struct Call {
+        uintptr_t   storage;        // when it started
+        ssize_t     slot;
+        bool        shared;         // ...with other vectors
+    };
+
+    static  void            init() __attribute__((constructor));
+    static  void            enter(const VectorImpl* vector, Call* call);
+    static  void            leave(const VectorImpl* vector, const Call& call);
+    static  void            forgetSlow(const void* storage);
+    static  size_t          scan(Stats* stats, bool trim);
+
+    static  bool            sEnabled;
+};
+
+/*
+ * Held by a VectorImpl call that may grow into, free or replace the storage
+ * of a vector, costing a test of a global flag while the registry is off.
+ * Calls nest.
+ */
+class VectorSlackScope
+{
+public:
+    inline explicit VectorSlackScope(const VectorImpl* vector)
+        : mVector(VectorSlack::isEnabled() ? vector : 0) {
+        if (mVector) {
+            VectorSlack::enter(mVector, &mCall);
+        }
+    }
+    inline ~VectorSlackScope() {
+        if (mVector) {
+            VectorSlack::leave(mVector, mCall);
+        }
+    }
+
+private:
+    VectorSlackScope(const VectorSlackScope&);
+    VectorSlackScope& operator = (const VectorSlackScope&);
+
+    const VectorImpl* const mVector;
+    VectorSlack::Call       mCall;
+};
+
+}; // namespace android
+
+#endif // NV_VECTOR_SLACK_H
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VectorTelemetry"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <new>
+
+#include <log/log.h>
+
+#include "NV_VectorConfig.h"
+#include "NV_VectorDump.h"
+#include "NV_VectorTelemetry.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+bool VectorTelemetry::sEnabled = false;
+
+namespace {
+
+enum {
+    CALLS,
+    BYTES,
+    REALLOCS,
+    NUM_COUNTERS
+};
+
+// Written only by the thread owning them, read by anyone: relaxed
+// load/store pairs, no read-modify-write needed.
+struct ThreadCounters {
+    std::atomic<uint64_t>   values[VectorTelemetry::NUM_BUCKETS][VectorTelemetry::NUM_OPS][NUM_COUNTERS];
+    std::atomic<size_t>     peakCapacity[VectorTelemetry::NUM_BUCKETS];
+    ThreadCounters*         next;
+    ThreadCounters*         prev;
+};
+
+inline void add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+pthread_key_t gCountersKey;
+
+// live threads, and the counters of the threads that are gone
+pthread_mutex_t gRegistryLock = PTHREAD_MUTEX_INITIALIZER;
+ThreadCounters* gThreads = 0;
+VectorTelemetry::Bucket gRetired[VectorTelemetry::NUM_BUCKETS];
+
+inline int bucketOf(size_t itemSize) {
+    if (itemSize > VectorTelemetry::MAX_ITEM_SIZE) {
+        return VectorTelemetry::NUM_BUCKETS - 1;
+    }
+    return int((itemSize - 1) / VectorTelemetry::BUCKET_GRANULE);
+}
+
+void addCounters(VectorTelemetry::Bucket* buckets, const ThreadCounters* counters)
+{
+    for (int b = 0 ; b < VectorTelemetry::NUM_BUCKETS ; b++) {
+        for (int op = 0 ; op < VectorTelemetry::NUM_OPS ; op++) {
+            const std::atomic<uint64_t>* values = counters->values[b][op];
+            VectorTelemetry::Counters& c = buckets[b].ops[op];
+            c.calls += values[CALLS].load(std::memory_order_relaxed);
+            c.bytes += values[BYTES].load(std::memory_order_relaxed);
+            c.reallocs += values[REALLOCS].load(std::memory_order_relaxed);
+        }
+        const size_t peak = counters->peakCapacity[b].load(std::memory_order_relaxed);
+        if (peak > buckets[b].peakCapacity) {
+            buckets[b].peakCapacity = peak;
+        }
+    }
+}
+
+void destroyCounters(void* data)
+{
+    ThreadCounters* counters = static_cast<ThreadCounters*>(data);
+    pthread_mutex_lock(&gRegistryLock);
+    addCounters(gRetired, counters);
+    if (counters->prev) counters->prev->next = counters->next;
+    else gThreads = counters->next;
+    if (counters->next) counters->next->prev = counters->prev;
+    pthread_mutex_unlock(&gRegistryLock);
+    delete counters;
+}
+
+ThreadCounters* getCounters()
+{
+    ThreadCounters* counters = static_cast<ThreadCounters*>(pthread_getspecific(gCountersKey));
+    if (!counters) {
+        counters = new (std::nothrow) ThreadCounters();
+        if (!counters) {
+            return 0;
+        }
+        pthread_setspecific(gCountersKey, counters);
+        pthread_mutex_lock(&gRegistryLock);
+        counters->next = gThreads;
+        if (gThreads) gThreads->prev = counters;
+        gThreads = counters;
+        pthread_mutex_unlock(&gRegistryLock);
+    }
+    return counters;
+}
+
+void dumpTelemetry()
+{
+    VectorTelemetry::dumpToFile();
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+// runs when the shim is loaded, before the libraries that depend on it
+void VectorTelemetry::init()
+{
+    if (!vectorConfigBool("VECTORIMPL_TELEMETRY", false)) {
+        return;
+    }
+    if (pthread_key_create(&gCountersKey, destroyCounters)) {
+        ALOGE("can't create the telemetry key, telemetry disabled");
+        return;
+    }
+
+    vectorDumpRegister(dumpTelemetry);
+    sEnabled = true;
+}
+
+void VectorTelemetry::recordSlow(Op op, size_t itemSize, size_t bytes,
+        bool reallocated, size_t capacity)
+{
+    ThreadCounters* counters = getCounters();
+    if (!counters) {
+        return;
+    }
+    const int b = bucketOf(itemSize);
+    std::atomic<uint64_t>* values = counters->values[b][op];
+    add(values[CALLS], 1);
+    add(values[BYTES], bytes);
+    if (reallocated) {
+        add(values[REALLOCS], 1);
+        std::atomic<size_t>& peak = counters->peakCapacity[b];
+        if (capacity > peak.load(std::memory_order_relaxed)) {
+            peak.store(capacity, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool VectorTelemetry::getStats(Bucket* buckets)
+{
+    if (!sEnabled) {
+        return false;
+    }
+    pthread_mutex_lock(&gRegistryLock);
+    memcpy(buckets, gRetired, sizeof(gRetired));
+    for (ThreadCounters* counters = gThreads ; counters ; counters = counters->next) {
+        addCounters(buckets, counters);
+    }
+    pthread_mutex_unlock(&gRegistryLock);
+    return true;
+}
+
+void VectorTelemetry::dumpStats(int fd)
+{
+    static const char* const kOpNames[NUM_OPS] = {
+        "grow", "shrink", "setCapacity", "edit", "sort", "editBatch"
+    };
+
+    Bucket buckets[NUM_BUCKETS];
+    if (!getStats(buckets)) {
+        dprintf(fd, "VectorTelemetry: disabled\n");
+        return;
+    }
+    dprintf(fd, "VectorTelemetry: pid %d\n", getpid());
+    dprintf(fd, "%8s %12s %12s %14s %12s %10s\n",
+            "item", "op", "calls", "bytes", "reallocs", "peak");
+    for (int b = 0 ; b < NUM_BUCKETS ; b++) {
+        char item[16];
+        if (b < NUM_BUCKETS - 1) {
+            snprintf(item, sizeof(item), "<=%d", (b + 1) * BUCKET_GRANULE);
+        } else {
+            snprintf(item, sizeof(item), ">%d", MAX_ITEM_SIZE);
+        }
+        for (int op = 0 ; op < NUM_OPS ; op++) {
+            const Counters& c = buckets[b].ops[op];
+            if (!c.calls) {
+                continue;
+            }
+            dprintf(fd, "%8s %12s %12llu %14llu %12llu %10zu\n",
+                    item, kOpNames[op], (unsigned long long)c.calls,
+                    (unsigned long long)c.bytes, (unsigned long long)c.reallocs,
+                    buckets[b].peakCapacity);
+        }
+    }
+}
+
+status_t VectorTelemetry::dumpToFile()
+{
+    if (!sEnabled) {
+        return INVALID_OPERATION;
+    }
+    const int fd = vectorDumpOpen(".txt");
+    if (fd < 0) {
+        return fd;
+    }
+    dumpStats(fd);
+    close(fd);
+    return NO_ERROR;
+}
+
+}; // namespace android
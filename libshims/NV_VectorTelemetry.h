@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTOR_TELEMETRY_H
+#define NV_VECTOR_TELEMETRY_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Counters of what the blobs do with VectorImpl, bucketed by item size.
+ *
+ * Every thread counts into its own block, which is only merged with the
+ * others when the counters are read, so recording never takes a lock nor
+ * a contended cache line. While telemetry is off, recording is a single
+ * test of a global flag.
+ *
+ * The totals are dumped to vectorimpl-<pid>.txt, see NV_VectorDump.h.
+ *
+ * Tunables:
+ *   VECTORIMPL_TELEMETRY           enable the counters (default off)
+ */
+class VectorTelemetry
+{
+public:
+    enum Op {
+        GROW,           // _grow(): insertions
+        SHRINK,         // _shrink(): removals
+        SET_CAPACITY,   // setCapacity() that reallocated
+        EDIT,           // editArrayImpl(), reallocating on copy-on-write
+        SORT,           // sort()
+        EDIT_BATCH,     // editBatch()
+        NUM_OPS
+    };
+
+    enum {
+        BUCKET_GRANULE  = 4,    // item sizes are counted per 4 bytes...
+        MAX_ITEM_SIZE   = 128,  // ...up to 128, the rest share a bucket
+        NUM_BUCKETS     = MAX_ITEM_SIZE / BUCKET_GRANULE + 1,
+    };
+
+    static inline bool isEnabled() { return sEnabled; }
+
+    /*! counts a call of op on a vector of itemSize items, which copied or
+     *  moved bytes (for sort(), sorted them) and, if it reallocated, left
+     *  the vector with room for capacity items */
+    static inline void record(Op op, size_t itemSize, size_t bytes,
+            bool reallocated, size_t capacity = 0) {
+        if (sEnabled) {
+            recordSlow(op, itemSize, bytes, reallocated, capacity);
+        }
+    }
+
+    struct Counters {
+        uint64_t    calls;
+        uint64_t    bytes;
+        uint64_t    reallocs;
+    };
+
+    struct Bucket {
+        Counters    ops[NUM_OPS];
+        size_t      peakCapacity;   // in items
+    };
+
+    /*! counters summed over all threads, NUM_BUCKETS of them, bucket i
+     *  holding items of up to (i + 1) * BUCKET_GRANULE bytes. Returns false
+     *  if telemetry is disabled. */
+    static  bool            getStats(Bucket* buckets);
+
+    //! writes the counters as text
+    static  void            dumpStats(int fd);
+
+    //! writes the counters to the dump file
+    static  status_t        dumpToFile();
+
+private:
+    static  void            init() __attribute__((constructor));
+    static  void            recordSlow(Op op, size_t itemSize, size_t bytes,
+                                    bool reallocated, size_t capacity);
+
+    static  bool            sEnabled;
+};
+
+}; // namespace android
+
+#endif // NV_VECTOR_TELEMETRY_H
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VectorTrace"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <unwind.h>
+
+#include <atomic>
+#include <new>
+
+#include <log/log.h>
+
+#include "NV_VectorConfig.h"
+#include "NV_VectorDump.h"
+#include "NV_VectorTrace.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+bool VectorTrace::sEnabled = false;
+
+namespace {
+
+const size_t kDefaultEntries = 1024;
+const size_t kMaxEntries = 1 << 20;
+
+// frames to walk looking for the first one outside of the shim
+const int kMaxCallerDepth = 16;
+
+const char* const kOpNames[VectorTrace::NUM_OPS] = {
+    "sort", "merge", "grow", "copy-on-write", "edit-batch"
+};
+
+/*
+ * Ring entries are claimed with a fetch_add on the head, so writers never
+ * wait for each other. An entry's sequence is 0 while it's being written
+ * and the claimed index + 1 once it's complete: the dump only keeps the
+ * entries whose sequence is the same before and after reading them.
+ */
+struct Entry {
+    std::atomic<uint32_t>   seq;
+    std::atomic<uint32_t>   op;
+    std::atomic<uint64_t>   start;
+    std::atomic<uint64_t>   duration;
+    std::atomic<uint32_t>   count;
+    std::atomic<uint32_t>   itemSize;
+    std::atomic<uint32_t>   tid;
+    std::atomic<uintptr_t>  caller;
+};
+
+uint64_t gThreshold = 0;    // in ns
+Entry* gRing = 0;
+uint32_t gMask = 0;
+std::atomic<uint32_t> gHead(0);
+
+const void* findShimBase()
+{
+    Dl_info info;
+    if (!dladdr(reinterpret_cast<void*>(&VectorTrace::finish), &info)) {
+        return 0;
+    }
+    return info.dli_fbase;
+}
+
+// set once, by whichever of the tracer and the real-time checker needs it
+// first
+const void* shimBase()
+{
+    static const void* const base = findShimBase();
+    return base;
+}
+
+struct CallerSearch {
+    const void* shimBase;
+    uintptr_t   caller;
+    int         depth;
+};
+
+_Unwind_Reason_Code searchCaller(struct _Unwind_Context* context, void* arg)
+{
+    CallerSearch* search = static_cast<CallerSearch*>(arg);
+    const uintptr_t ip = _Unwind_GetIP(context);
+    Dl_info info;
+    if (ip && (!dladdr(reinterpret_cast<void*>(ip), &info) ||
+            info.dli_fbase != search->shimBase)) {
+        search->caller = ip;
+        return _URC_END_OF_STACK;
+    }
+    return ++search->depth < kMaxCallerDepth ? _URC_NO_REASON : _URC_END_OF_STACK;
+}
+
+void dumpTrace()
+{
+    VectorTrace::dumpToFile();
+}
+
+void dumpProcessName(int fd)
+{
+    char name[128];
+    const int cmdline = open("/proc/self/cmdline", O_RDONLY | O_CLOEXEC);
+    ssize_t n = cmdline < 0 ? -1 : read(cmdline, name, sizeof(name) - 1);
+    if (cmdline >= 0) {
+        close(cmdline);
+    }
+    name[n > 0 ? n : 0] = '\0';
+    for (char* p = name ; *p ; p++) {
+        if (*p == '"' || *p == '\\' || *p < ' ') *p = '_';
+    }
+    dprintf(fd, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}", getpid(), name);
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+// runs when the shim is loaded, before the libraries that depend on it
+void VectorTrace::init()
+{
+    const size_t threshold = vectorConfigSize("VECTORIMPL_TRACE_US", 0);
+    if (!threshold) {
+        return;
+    }
+
+    size_t entries = vectorConfigSize("VECTORIMPL_TRACE_ENTRIES", kDefaultEntries);
+    if (entries < 2 || entries > kMaxEntries) {
+        ALOGW("VECTORIMPL_TRACE_ENTRIES=%zu out of [2, %zu], using %zu",
+                entries, kMaxEntries, kDefaultEntries);
+        entries = kDefaultEntries;
+    }
+    entries = size_t(1) << (sizeof(unsigned long) * 8 - __builtin_clzl(entries - 1));
+
+    if (!shimBase()) {
+        ALOGE("can't find the shim, tracing disabled");
+        return;
+    }
+    gRing = new (std::nothrow) Entry[entries]();
+    if (!gRing) {
+        ALOGE("can't allocate %zu trace entries, tracing disabled", entries);
+        return;
+    }
+    gMask = uint32_t(entries - 1);
+    gThreshold = uint64_t(threshold) * 1000;
+    vectorDumpRegister(dumpTrace);
+    sEnabled = true;
+}
+
+uint64_t VectorTrace::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+void VectorTrace::finish(Op op, uint64_t start, size_t count, size_t itemSize)
+{
+    const uint64_t duration = now() - start;
+    if (duration < gThreshold) {
+        return;
+    }
+
+    // only slow operations get here, they can afford the unwinding
+    const uintptr_t caller = findCaller();
+
+    const uint32_t index = gHead.fetch_add(1, std::memory_order_relaxed);
+    Entry& e = gRing[index & gMask];
+    e.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e.op.store(op, std::memory_order_relaxed);
+    e.start.store(start, std::memory_order_relaxed);
+    e.duration.store(duration, std::memory_order_relaxed);
+    e.count.store(uint32_t(count), std::memory_order_relaxed);
+    e.itemSize.store(uint32_t(itemSize), std::memory_order_relaxed);
+    e.tid.store(uint32_t(syscall(__NR_gettid)), std::memory_order_relaxed);
+    e.caller.store(caller, std::memory_order_relaxed);
+    e.seq.store(index + 1, std::memory_order_release);
+}
+
+uintptr_t VectorTrace::findCaller()
+{
+    CallerSearch search = { shimBase(), 0, 0 };
+    if (search.shimBase) {
+        _Unwind_Backtrace(searchCaller, &search);
+    }
+    return search.caller;
+}
+
+void VectorTrace::formatCaller(uintptr_t caller, char* buffer, size_t size)
+{
+    Dl_info info;
+    if (caller && dladdr(reinterpret_cast<void*>(caller), &info) && info.dli_fname) {
+        const char* name = strrchr(info.dli_fname, '/');
+        snprintf(buffer, size, "%s+0x%zx", name ? name + 1 : info.dli_fname,
+                size_t(caller - reinterpret_cast<uintptr_t>(info.dli_fbase)));
+    } else if (caller) {
+        snprintf(buffer, size, "0x%zx", size_t(caller));
+    } else {
+        snprintf(buffer, size, "?");
+    }
+}
+
+void VectorTrace::dump(int fd)
+{
+    const pid_t pid = getpid();
+    dprintf(fd, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    dumpProcessName(fd);
+    if (sEnabled) {
+        const uint32_t head = gHead.load(std::memory_order_relaxed);
+        const uint32_t size = gMask + 1;
+        const uint32_t first = head > size ? head - size : 0;
+        for (uint32_t index = first ; index != head ; index++) {
+            const Entry& e = gRing[index & gMask];
+            if (e.seq.load(std::memory_order_acquire) != index + 1) {
+                continue;
+            }
+            const uint32_t op = e.op.load(std::memory_order_relaxed);
+            const uint64_t start = e.start.load(std::memory_order_relaxed);
+            const uint64_t duration = e.duration.load(std::memory_order_relaxed);
+            const uint32_t count = e.count.load(std::memory_order_relaxed);
+            const uint32_t itemSize = e.itemSize.load(std::memory_order_relaxed);
+            const uint32_t tid = e.tid.load(std::memory_order_relaxed);
+            const uintptr_t caller = e.caller.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (e.seq.load(std::memory_order_relaxed) != index + 1 || op >= NUM_OPS) {
+                continue;
+            }
+
+            char where[160];
+            formatCaller(caller, where, sizeof(where));
+
+            dprintf(fd, ",\n{\"name\":\"%s\",\"cat\":\"vectorimpl\",\"ph\":\"X\","
+                    "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,"
+                    "\"args\":{\"count\":%u,\"itemSize\":%u,\"caller\":\"%s\"}}",
+                    kOpNames[op], start / 1000.0, duration / 1000.0, pid, tid,
+                    count, itemSize, where);
+        }
+    }
+    dprintf(fd, "\n]}\n");
+}
+
+status_t VectorTrace::dumpToFile()
+{
+    if (!sEnabled) {
+        return INVALID_OPERATION;
+    }
+    const int fd = vectorDumpOpen(".trace.json");
+    if (fd < 0) {
+        return fd;
+    }
+    dump(fd);
+    close(fd);
+    return NO_ERROR;
+}
+
+}; // namespace android
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTOR_TRACE_H
+#define NV_VECTOR_TRACE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Tracer of the individual VectorImpl operations that run for longer than
+ * a threshold: when one does, its duration, item count, item size and the
+ * first return address outside of the shim (the blob code that called it)
+ * go into a ring buffer shared by all threads, without any lock.
+ *
+ * The ring is dumped to vectorimpl-<pid>.trace.json (see NV_VectorDump.h)
+ * as Chrome trace events, which chrome://tracing and Perfetto load as is.
+ * Callers show up as "library+offset", ready for addr2line.
+ *
+ * Tunables:
+ *   VECTORIMPL_TRACE_US        threshold in microseconds (default 0: off)
+ *   VECTORIMPL_TRACE_ENTRIES   ring size, rounded up to a power of two
+ *                              (default 1024)
+ */
+class VectorTrace
+{
+public:
+    enum Op {
+        SORT,
+        MERGE,
+        GROW,
+        COPY_ON_WRITE,
+        EDIT_BATCH,
+        NUM_OPS
+    };
+
+    static inline bool isEnabled() { return sEnabled; }
+
+    //! monotonic time in nanoseconds
+    static  uint64_t        now();
+
+    //! records op if it has been running since start for too long
+    static  void            finish(Op op, uint64_t start, size_t count, size_t itemSize);
+
+    /*! first return address outside of the shim on the stack of the
+     *  calling thread, 0 if there's none within a few frames. Unwinds, so
+     *  it's only for paths that are slow already. */
+    static  uintptr_t       findCaller();
+
+    //! writes caller as "library+offset", or "?" for 0
+    static  void            formatCaller(uintptr_t caller, char* buffer, size_t size);
+
+    //! writes the ring as trace events
+    static  void            dump(int fd);
+    static  status_t        dumpToFile();
+
+private:
+    static  void            init() __attribute__((constructor));
+
+    static  bool            sEnabled;
+};
+
+/*
+ * Times the enclosing block as op, costing a test of a global flag while
+ * the tracer is off.
+ */
+class VectorTraceScope
+{
+public:
+    inline VectorTraceScope(VectorTrace::Op op, size_t count, size_t itemSize)
+        : mOp(op), mCount(count), mItemSize(itemSize),
+          mStart(VectorTrace::isEnabled() ? VectorTrace::now() : 0) {
+    }
+    inline ~VectorTraceScope() {
+        if (mStart) {
+            VectorTrace::finish(mOp, mStart, mCount, mItemSize);
+        }
+    }
+
+private:
+    VectorTraceScope(const VectorTraceScope&);
+    VectorTraceScope& operator = (const VectorTraceScope&);
+
+    const VectorTrace::Op   mOp;
+    const size_t            mCount;
+    const size_t            mItemSize;
+    const uint64_t          mStart;
+};
+
+}; // namespace android
+
+#endif // NV_VECTOR_TRACE_H
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VectorWorkers"
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "NV_VectorConfig.h"
+#include "NV_VectorWorkers.h"
+
+/*****************************************************************************/
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+namespace {
+
+const size_t kDefaultWorkers = 4;
+const size_t kDefaultSortParallelMin = 16384;
+
+size_t gConcurrency = 1;
+size_t gSortParallelMin = 0;
+
+// A batch lives on the stack of the thread that run() it. Everything in it
+// but the task itself is only touched under gLock, so the batch can go as
+// soon as its last task has reported in.
+struct Batch {
+    VectorWorkers::task_t   task;
+    void*                   state;
+    size_t                  count;
+    size_t                  next;       // first task nobody took yet
+    size_t                  finished;
+    Batch*                  link;
+};
+
+pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t gWork = PTHREAD_COND_INITIALIZER;
+pthread_cond_t gDone = PTHREAD_COND_INITIALIZER;
+Batch* gQueue = 0;  // batches with tasks left to take
+pthread_once_t gStartOnce = PTHREAD_ONCE_INIT;
+
+// takes the next task of the batch, unqueueing it with the last one.
+// Called with gLock held.
+bool takeTask(Batch* batch, size_t* index)
+{
+    if (batch->next == batch->count) {
+        return false;
+    }
+    *index = batch->next++;
+    if (batch->next == batch->count) {
+        for (Batch** b = &gQueue ; *b ; b = &(*b)->link) {
+            if (*b == batch) {
+                *b = batch->link;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// runs a task taken with gLock held, and reports it done. Returns with
+// gLock held.
+void runTask(Batch* batch, size_t index)
+{
+    pthread_mutex_unlock(&gLock);
+    batch->task(batch->state, index);
+    pthread_mutex_lock(&gLock);
+    if (++batch->finished == batch->count) {
+        pthread_cond_broadcast(&gDone);
+    }
+}
+
+void* workerThread(void*)
+{
+    pthread_mutex_lock(&gLock);
+    for (;;) {
+        while (!gQueue) {
+            pthread_cond_wait(&gWork, &gLock);
+        }
+        Batch* batch = gQueue;
+        size_t index;
+        if (takeTask(batch, &index)) {
+            runTask(batch, index);
+        }
+    }
+    return NULL;
+}
+
+void startWorkers()
+{
+    // the workers must not take any of the process' signals
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    size_t started = 0;
+    for ( ; started < gConcurrency - 1 ; started++) {
+        pthread_t thread;
+        const int err = pthread_create(&thread, &attr, workerThread, NULL);
+        if (err) {
+            // run() still works, with fewer hands
+            ALOGW("can't start worker %zu: %s", started, strerror(err));
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+// runs when the shim is loaded, before the libraries that depend on it
+__attribute__((constructor))
+void loadWorkers()
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) {
+        cores = 1;
+    }
+    size_t workers = vectorConfigSize("VECTORIMPL_WORKERS",
+            size_t(cores) < kDefaultWorkers ? size_t(cores) : kDefaultWorkers);
+    if (workers < 1 || workers > VectorWorkers::MAX_THREADS) {
+        const size_t clamped = workers < 1 ? 1 : VectorWorkers::MAX_THREADS;
+        ALOGW("VECTORIMPL_WORKERS=%zu out of [1, %d], using %zu",
+                workers, VectorWorkers::MAX_THREADS, clamped);
+        workers = clamped;
+    }
+    gConcurrency = workers;
+    gSortParallelMin = vectorConfigSize("VECTORIMPL_SORT_PARALLEL_MIN", kDefaultSortParallelMin);
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+size_t VectorWorkers::concurrency()
+{
+    return gConcurrency;
+}
+
+size_t VectorWorkers::sortParallelMin()
+{
+    return gConcurrency > 1 ? gSortParallelMin : 0;
+}
+
+void VectorWorkers::run(task_t task, void* state, size_t count)
+{
+    if (gConcurrency > 1 && count > 1) {
+        pthread_once(&gStartOnce, startWorkers);
+    }
+    if (gConcurrency <= 1 || count <= 1) {
+        for (size_t i = 0 ; i < count ; i++) {
+            task(state, i);
+        }
+        return;
+    }
+
+    Batch batch;
+    batch.task = task;
+    batch.state = state;
+    batch.count = count;
+    batch.next = 0;
+    batch.finished = 0;
+    pthread_mutex_lock(&gLock);
+    batch.link = gQueue;
+    gQueue = &batch;
+    pthread_cond_broadcast(&gWork);
+    size_t index;
+    while (takeTask(&batch, &index)) {
+        runTask(&batch, index);
+    }
+    while (batch.finished != batch.count) {
+        pthread_cond_wait(&gDone, &gLock);
+    }
+    pthread_mutex_unlock(&gLock);
+}
+
+}; // namespace android
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTOR_WORKERS_H
+#define NV_VECTOR_WORKERS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Small pool of worker threads for the operations of the shim that can
+ * be split over the cores, like VectorImpl::sort() on large arrays.
+ *
+ * The threads are only started by the first run() that wants them, and
+ * then wait for work with every signal blocked. The calling thread works
+ * on its own batch too, so a busy or missing pool only costs parallelism.
+ *
+ * Tunables:
+ *   VECTORIMPL_WORKERS             threads working on a batch, the caller
+ *                                  included (default: online cores, at
+ *                                  most 4); 1 disables the pool
+ *   VECTORIMPL_SORT_PARALLEL_MIN   sort() splits arrays of at least this
+ *                                  many items over the workers (default
+ *                                  16k, 0 never)
+ */
+class VectorWorkers
+{
+public:
+    enum {
+        MAX_THREADS = 16,
+    };
+
+    typedef void (*task_t)(void* state, size_t index);
+
+    //! threads a batch can run on, the caller included
+    static  size_t          concurrency();
+
+    //! smallest sort() handed to the workers, 0 for none
+    static  size_t          sortParallelMin();
+
+    /*! runs task(state, i) for every i in [0, count) on the workers and
+     *  the calling thread, and returns once they're all done */
+    static  void            run(task_t task, void* state, size_t count);
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // NV_VECTOR_WORKERS_H
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Benchmark.h"
+#include "NV_VectorPool.h"
+#include "NV_VectorTelemetry.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+struct BenchmarkEntry {
+    const char*         name;
+    BenchmarkFunction   function;
+    const size_t*       counts;
+    size_t              numCounts;
+    BenchmarkEntry*     next;
+};
+
+// plain pointers are constant-initialized, so registrations from other
+// translation units can't run before these are set up
+BenchmarkEntry* gFirstEntry = 0;
+BenchmarkEntry* gLastEntry = 0;
+
+enum Format {
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON,
+};
+
+struct Options {
+    Format          format;
+    const char*     filter;
+    int64_t         minTimeNs;
+};
+
+void printUsage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [--format=text|csv|json] [--filter=SUBSTRING] [--min_time_ms=N]\n"
+            "\n"
+            "  --format       text (default), csv, or json in the format used by\n"
+            "                 google-benchmark, so its compare.py can diff two runs\n"
+            "  --filter       only run benchmarks whose name contains SUBSTRING\n"
+            "  --min_time_ms  minimum run time of each benchmark (default 50)\n",
+            name);
+}
+
+bool parseOptions(int argc, char** argv, Options* options)
+{
+    options->format = FORMAT_TEXT;
+    options->filter = 0;
+    options->minTimeNs = 50 * 1000000LL;
+    for (int i = 1 ; i < argc ; i++) {
+        const char* arg = argv[i];
+        if (!strcmp(arg, "--format=text")) {
+            options->format = FORMAT_TEXT;
+        } else if (!strcmp(arg, "--format=csv")) {
+            options->format = FORMAT_CSV;
+        } else if (!strcmp(arg, "--format=json")) {
+            options->format = FORMAT_JSON;
+        } else if (!strncmp(arg, "--filter=", 9)) {
+            options->filter = arg + 9;
+        } else if (!strncmp(arg, "--min_time_ms=", 14)) {
+            options->minTimeNs = atoll(arg + 14) * 1000000LL;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+void printHeader(const Options& options)
+{
+    switch (options.format) {
+        case FORMAT_TEXT:
+            printf("%-40s %12s %14s  %s\n", "benchmark", "iterations", "ns/op", "counters");
+            break;
+        case FORMAT_CSV:
+            printf("name,iterations,real_time,time_unit,counters\n");
+            break;
+        case FORMAT_JSON: {
+            char host[64] = "unknown";
+            gethostname(host, sizeof(host) - 1);
+            printf("{\n  \"context\": {\n");
+            printf("    \"host_name\": \"%s\",\n", host);
+            printf("    \"num_cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+            printf("    \"library_build_type\": \"%s\"\n",
+#ifdef NDEBUG
+                    "release"
+#else
+                    "debug"
+#endif
+                    );
+            printf("  },\n  \"benchmarks\": [");
+            break;
+        }
+    }
+}
+
+void printResult(const Options& options, const char* name, const BenchmarkRun& run, bool first)
+{
+    const double nsPerOp = double(run.elapsed()) / run.iterations();
+    switch (options.format) {
+        case FORMAT_TEXT:
+            printf("%-40s %12zu %14.1f ", name, run.iterations(), nsPerOp);
+            for (size_t i = 0 ; i < run.counters() ; i++) {
+                printf(" %s=%.1f", run.counter(i).name, run.counter(i).value);
+            }
+            printf("\n");
+            break;
+        case FORMAT_CSV:
+            printf("%s,%zu,%.1f,ns,", name, run.iterations(), nsPerOp);
+            for (size_t i = 0 ; i < run.counters() ; i++) {
+                printf("%s%s=%.1f", i ? ";" : "", run.counter(i).name, run.counter(i).value);
+            }
+            printf("\n");
+            break;
+        case FORMAT_JSON:
+            printf("%s\n    {\n", first ? "" : ",");
+            printf("      \"name\": \"%s\",\n", name);
+            printf("      \"iterations\": %zu,\n", run.iterations());
+            printf("      \"real_time\": %.1f,\n", nsPerOp);
+            printf("      \"cpu_time\": %.1f,\n", nsPerOp);
+            for (size_t i = 0 ; i < run.counters() ; i++) {
+                printf("      \"%s\": %.1f,\n", run.counter(i).name, run.counter(i).value);
+            }
+            printf("      \"time_unit\": \"ns\"\n    }");
+            break;
+    }
+    fflush(stdout);
+}
+
+void printFooter(const Options& options)
+{
+    if (options.format == FORMAT_JSON) {
+        printf("\n  ]\n}\n");
+    }
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+
+BenchmarkRun::BenchmarkRun(size_t count, size_t iterations)
+    : mCount(count), mIterations(iterations), mStart(0), mElapsed(0), mNumCounters(0)
+{
+}
+
+void BenchmarkRun::setCounter(const char* name, double value)
+{
+    for (size_t i = 0 ; i < mNumCounters ; i++) {
+        if (!strcmp(mCounters[i].name, name)) {
+            mCounters[i].value = value;
+            return;
+        }
+    }
+    if (mNumCounters < MAX_COUNTERS) {
+        mCounters[mNumCounters].name = name;
+        mCounters[mNumCounters].value = value;
+        mNumCounters++;
+    }
+}
+
+void BenchmarkRegistration::add(const char* name, BenchmarkFunction function,
+        const size_t* counts, size_t numCounts)
+{
+    BenchmarkEntry* entry = new BenchmarkEntry;
+    entry->name = name;
+    entry->function = function;
+    entry->counts = counts;
+    entry->numCounts = numCounts;
+    entry->next = 0;
+    if (gLastEntry) {
+        gLastEntry->next = entry;
+    } else {
+        gFirstEntry = entry;
+    }
+    gLastEntry = entry;
+}
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+using namespace android;
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    printHeader(options);
+    bool first = true;
+    for (const BenchmarkEntry* e = gFirstEntry ; e ; e = e->next) {
+        for (size_t c = 0 ; c < e->numCounts ; c++) {
+            char name[128];
+            snprintf(name, sizeof(name), "%s/%zu", e->name, e->counts[c]);
+            if (options.filter && !strstr(name, options.filter)) {
+                continue;
+            }
+
+            // grow the iteration count until the run is long enough to
+            // be meaningful, then report that last run
+            size_t iterations = 1;
+            while (true) {
+                BenchmarkRun run(e->counts[c], iterations);
+                e->function(run);
+                if (run.elapsed() >= options.minTimeNs || iterations >= 1000000000) {
+                    printResult(options, name, run, first);
+                    first = false;
+                    break;
+                }
+                const int64_t elapsed = run.elapsed() > 0 ? run.elapsed() : 1;
+                const double scale = 1.4 * options.minTimeNs / elapsed;
+                size_t next = size_t(iterations * (scale < 10.0 ? scale : 10.0));
+                iterations = next > iterations ? next : iterations + 1;
+            }
+        }
+    }
+    printFooter(options);
+
+    // counters go to stderr, to keep stdout machine-readable
+    if (VectorPool::isEnabled()) {
+        VectorPool::dumpStats(STDERR_FILENO);
+    }
+    if (VectorTelemetry::isEnabled()) {
+        VectorTelemetry::dumpStats(STDERR_FILENO);
+    }
+    return 0;
+}
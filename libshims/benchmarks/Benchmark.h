@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTORIMPL_BENCHMARK_H
+#define NV_VECTORIMPL_BENCHMARK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * A tiny self-contained benchmark harness, so the suite builds the same
+ * way on the device and on a plain Linux host.
+ *
+ * A benchmark function runs iterations() times and brackets the code to
+ * measure with resume()/pause(); everything outside (building inputs,
+ * tearing down copies) is not timed. The harness picks the iteration
+ * count so that each run takes at least --min_time_ms.
+ */
+class BenchmarkRun
+{
+public:
+    BenchmarkRun(size_t count, size_t iterations);
+
+    //! problem size the benchmark was registered with
+    inline  size_t          count() const       { return mCount; }
+    inline  size_t          iterations() const  { return mIterations; }
+
+    inline  void            resume()            { mStart = now(); }
+    inline  void            pause()             { mElapsed += now() - mStart; }
+    inline  int64_t         elapsed() const     { return mElapsed; }
+
+    /*! reports an extra per-iteration value next to the timing */
+            void            setCounter(const char* name, double value);
+
+    enum { MAX_COUNTERS = 4 };
+    struct Counter {
+        const char*         name;
+        double              value;
+    };
+    inline  size_t          counters() const    { return mNumCounters; }
+    inline  const Counter&  counter(size_t i) const { return mCounters[i]; }
+
+    static inline int64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+    }
+
+private:
+    const   size_t          mCount;
+    const   size_t          mIterations;
+            int64_t         mStart;
+            int64_t         mElapsed;
+            size_t          mNumCounters;
+            Counter         mCounters[MAX_COUNTERS];
+};
+
+typedef void (*BenchmarkFunction)(BenchmarkRun& run);
+
+/*
+ * Registers a benchmark at static-initialization time. It will be run once
+ * for every problem size in counts[].
+ */
+class BenchmarkRegistration
+{
+public:
+    template <size_t N>
+    BenchmarkRegistration(const char* name, BenchmarkFunction function,
+            const size_t (&counts)[N]) {
+        add(name, function, counts, N);
+    }
+
+private:
+    void add(const char* name, BenchmarkFunction function,
+            const size_t* counts, size_t numCounts);
+};
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Item types used across the suite: a 32-bit key followed by padding up
+ * to SIZE bytes, so the same code measures 4, 16 and 64 byte items.
+ */
+template <size_t SIZE>
+struct BenchmarkItem {
+    int32_t key;
+    int32_t payload[SIZE/sizeof(int32_t) - 1];
+};
+
+template <>
+struct BenchmarkItem<sizeof(int32_t)> {
+    int32_t key;
+};
+
+template <typename TYPE>
+inline TYPE makeBenchmarkItem(int32_t key) {
+    TYPE item;
+    memset(&item, 0, sizeof(item));
+    item.key = key;
+    return item;
+}
+
+/*
+ * Registers fn<TYPE, FLAGS> for every item size and flag combination
+ * of the suite: "pod" has all the HAS_TRIVIAL_* flags, "copy" only
+ * HAS_TRIVIAL_COPY (memcpy, but no in-place resize) and "none" goes
+ * through the virtual do_* callbacks for everything.
+ */
+#define BENCHMARK_ITEM_FLAGS(name, fn, counts, size)                            \
+    static BenchmarkRegistration name##_##size##_pod(#name "/" #size "/pod",    \
+            fn<BenchmarkItem<size>, kPodFlags>, counts);                        \
+    static BenchmarkRegistration name##_##size##_copy(#name "/" #size "/copy",  \
+            fn<BenchmarkItem<size>, kCopyFlags>, counts);                       \
+    static BenchmarkRegistration name##_##size##_none(#name "/" #size "/none",  \
+            fn<BenchmarkItem<size>, kNoFlags>, counts)
+
+#define BENCHMARK_ALL_ITEMS(name, fn, counts)                                   \
+    BENCHMARK_ITEM_FLAGS(name, fn, counts, 4);                                  \
+    BENCHMARK_ITEM_FLAGS(name, fn, counts, 16);                                 \
+    BENCHMARK_ITEM_FLAGS(name, fn, counts, 64)
+
+/*
+ * The same, without "none", for code that only takes HAS_TRIVIAL_COPY items.
+ */
+#define BENCHMARK_COPYABLE_ITEM_FLAGS(name, fn, counts, size)                   \
+    static BenchmarkRegistration name##_##size##_pod(#name "/" #size "/pod",    \
+            fn<BenchmarkItem<size>, kPodFlags>, counts);                        \
+    static BenchmarkRegistration name##_##size##_copy(#name "/" #size "/copy",  \
+            fn<BenchmarkItem<size>, kCopyFlags>, counts)
+
+#define BENCHMARK_COPYABLE_ITEMS(name, fn, counts)                              \
+    BENCHMARK_COPYABLE_ITEM_FLAGS(name, fn, counts, 4);                         \
+    BENCHMARK_COPYABLE_ITEM_FLAGS(name, fn, counts, 16);                        \
+    BENCHMARK_COPYABLE_ITEM_FLAGS(name, fn, counts, 64)
+
+/*
+ * "none" items with only HAS_TRIVIAL_MOVE, standing in for relocatable
+ * types like sp<> that still need their copy and destroy callbacks.
+ */
+#define BENCHMARK_MOVABLE_ITEM_FLAGS(name, fn, counts, size)                    \
+    static BenchmarkRegistration name##_##size##_move(#name "/" #size "/move",  \
+            fn<BenchmarkItem<size>, kMoveFlags>, counts)
+
+#define BENCHMARK_MOVABLE_ITEMS(name, fn, counts)                               \
+    BENCHMARK_MOVABLE_ITEM_FLAGS(name, fn, counts, 4);                          \
+    BENCHMARK_MOVABLE_ITEM_FLAGS(name, fn, counts, 16);                         \
+    BENCHMARK_MOVABLE_ITEM_FLAGS(name, fn, counts, 64)
+
+}; // namespace android
+
+#endif // NV_VECTORIMPL_BENCHMARK_H
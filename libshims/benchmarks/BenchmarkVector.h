@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NV_VECTORIMPL_BENCHMARK_VECTOR_H
+#define NV_VECTORIMPL_BENCHMARK_VECTOR_H
+
+#include <new>
+#include <stdint.h>
+
+#include "NV_ChunkedSortedVectorImpl.h"
+#include "NV_VectorImpl.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+const uint32_t kPodFlags = VectorImpl::HAS_TRIVIAL_CTOR |
+                           VectorImpl::HAS_TRIVIAL_DTOR |
+                           VectorImpl::HAS_TRIVIAL_COPY;
+const uint32_t kCopyFlags = VectorImpl::HAS_TRIVIAL_COPY;
+const uint32_t kMoveFlags = VectorImpl::HAS_TRIVIAL_MOVE;
+const uint32_t kNoFlags = 0;
+
+/*
+ * Minimal typed front-ends for the shim, standing in for the Vector<> and
+ * SortedVector<> templates the blobs were built with. FLAGS selects which
+ * HAS_TRIVIAL_* flags are passed, so both the memcpy paths and the virtual
+ * do_* paths can be measured with the same item type.
+ */
+template <typename TYPE>
+struct BenchmarkTypeOps {
+    static void construct(void* storage, size_t num) {
+        TYPE* p = reinterpret_cast<TYPE*>(storage);
+        while (num--) new (p++) TYPE();
+    }
+    static void destroy(void* storage, size_t num) {
+        TYPE* p = reinterpret_cast<TYPE*>(storage);
+        while (num--) (p++)->~TYPE();
+    }
+    static void copy(void* dest, const void* from, size_t num) {
+        TYPE* d = reinterpret_cast<TYPE*>(dest);
+        const TYPE* s = reinterpret_cast<const TYPE*>(from);
+        while (num--) new (d++) TYPE(*s++);
+    }
+    static void splat(void* dest, const void* item, size_t num) {
+        TYPE* d = reinterpret_cast<TYPE*>(dest);
+        const TYPE& s = *reinterpret_cast<const TYPE*>(item);
+        while (num--) new (d++) TYPE(s);
+    }
+    static void move_forward(void* dest, const void* from, size_t num) {
+        TYPE* d = reinterpret_cast<TYPE*>(dest) + num;
+        TYPE* s = const_cast<TYPE*>(reinterpret_cast<const TYPE*>(from)) + num;
+        while (num--) {
+            --d, --s;
+            new (d) TYPE(*s);
+            s->~TYPE();
+        }
+    }
+    static void move_backward(void* dest, const void* from, size_t num) {
+        TYPE* d = reinterpret_cast<TYPE*>(dest);
+        TYPE* s = const_cast<TYPE*>(reinterpret_cast<const TYPE*>(from));
+        while (num--) {
+            new (d) TYPE(*s);
+            s->~TYPE();
+            d++, s++;
+        }
+    }
+    static int compare(const void* lhs, const void* rhs) {
+        const int32_t l = reinterpret_cast<const TYPE*>(lhs)->key;
+        const int32_t r = reinterpret_cast<const TYPE*>(rhs)->key;
+        return l < r ? -1 : (l > r ? 1 : 0);
+    }
+};
+
+#define BENCHMARK_VECTOR_OPS(TYPE)                                                          \
+    virtual void do_construct(void* storage, size_t num) const {                           \
+        BenchmarkTypeOps<TYPE>::construct(storage, num); }                                  \
+    virtual void do_destroy(void* storage, size_t num) const {                             \
+        BenchmarkTypeOps<TYPE>::destroy(storage, num); }                                    \
+    virtual void do_copy(void* dest, const void* from, size_t num) const {                 \
+        BenchmarkTypeOps<TYPE>::copy(dest, from, num); }                                    \
+    virtual void do_splat(void* dest, const void* item, size_t num) const {                \
+        BenchmarkTypeOps<TYPE>::splat(dest, item, num); }                                   \
+    virtual void do_move_forward(void* dest, const void* from, size_t num) const {         \
+        BenchmarkTypeOps<TYPE>::move_forward(dest, from, num); }                            \
+    virtual void do_move_backward(void* dest, const void* from, size_t num) const {        \
+        BenchmarkTypeOps<TYPE>::move_backward(dest, from, num); }
+
+template <typename TYPE, uint32_t FLAGS>
+class BenchmarkVector : public VectorImpl
+{
+public:
+    BenchmarkVector() : VectorImpl(sizeof(TYPE), FLAGS) { }
+    BenchmarkVector(const BenchmarkVector& rhs) : VectorImpl(rhs) { }
+    BenchmarkVector(BenchmarkVector&& rhs) : VectorImpl(static_cast<VectorImpl&&>(rhs)) { }
+    virtual ~BenchmarkVector() { finish_vector(); }
+
+    BenchmarkVector& operator = (const BenchmarkVector& rhs) {
+        VectorImpl::operator = (rhs);
+        return *this;
+    }
+    BenchmarkVector& operator = (BenchmarkVector&& rhs) {
+        VectorImpl::operator = (static_cast<VectorImpl&&>(rhs));
+        return *this;
+    }
+
+    inline const TYPE& operator[](size_t index) const {
+        return reinterpret_cast<const TYPE*>(arrayImpl())[index];
+    }
+
+protected:
+    BENCHMARK_VECTOR_OPS(TYPE)
+};
+
+template <typename TYPE, uint32_t FLAGS>
+class BenchmarkSortedVector : public SortedVectorImpl
+{
+public:
+    BenchmarkSortedVector() : SortedVectorImpl(sizeof(TYPE), FLAGS) { }
+    BenchmarkSortedVector(const BenchmarkSortedVector& rhs) : SortedVectorImpl(rhs) { }
+    virtual ~BenchmarkSortedVector() { finish_vector(); }
+
+    inline const TYPE& operator[](size_t index) const {
+        return reinterpret_cast<const TYPE*>(arrayImpl())[index];
+    }
+
+protected:
+    BENCHMARK_VECTOR_OPS(TYPE)
+    virtual int do_compare(const void* lhs, const void* rhs) const {
+        return BenchmarkTypeOps<TYPE>::compare(lhs, rhs);
+    }
+};
+
+template <typename TYPE, uint32_t FLAGS>
+class BenchmarkChunkedSortedVector : public ChunkedSortedVectorImpl
+{
+public:
+    BenchmarkChunkedSortedVector() : ChunkedSortedVectorImpl(sizeof(TYPE), FLAGS) { }
+    virtual ~BenchmarkChunkedSortedVector() { finish_vector(); }
+
+    inline const TYPE& operator[](size_t index) const {
+        return *reinterpret_cast<const TYPE*>(itemLocation(index));
+    }
+
+protected:
+    virtual void do_destroy(void* storage, size_t num) const {
+        BenchmarkTypeOps<TYPE>::destroy(storage, num);
+    }
+    virtual void do_copy(void* dest, const void* from, size_t num) const {
+        BenchmarkTypeOps<TYPE>::copy(dest, from, num);
+    }
+    virtual void do_move_forward(void* dest, const void* from, size_t num) const {
+        BenchmarkTypeOps<TYPE>::move_forward(dest, from, num);
+    }
+    virtual void do_move_backward(void* dest, const void* from, size_t num) const {
+        BenchmarkTypeOps<TYPE>::move_backward(dest, from, num);
+    }
+    virtual int do_compare(const void* lhs, const void* rhs) const {
+        return BenchmarkTypeOps<TYPE>::compare(lhs, rhs);
+    }
+};
+
+}; // namespace android
+
+#endif // NV_VECTORIMPL_BENCHMARK_VECTOR_H
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "Benchmark.h"
+#include "BenchmarkVector.h"
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * SortedVectorImpl against ChunkedSortedVectorImpl on the same workloads,
+ * "sorted" and "chunked" side by side, at table sizes that bracket the
+ * point where moving the tail starts to dominate.
+ */
+
+namespace {
+
+const size_t kChurnOps = 256;
+
+template <template <typename, uint32_t> class VECTOR, typename TYPE, uint32_t FLAGS>
+void fillEven(VECTOR<TYPE, FLAGS>& v, size_t count)
+{
+    for (size_t i = 0 ; i < count ; i++) {
+        const TYPE item = makeBenchmarkItem<TYPE>(int32_t(i * 2));
+        v.add(&item);
+    }
+}
+
+// add() of count random keys into an empty table
+template <template <typename, uint32_t> class VECTOR, typename TYPE, uint32_t FLAGS>
+void benchAddRandom(BenchmarkRun& run)
+{
+    srand(run.count());
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        VECTOR<TYPE, FLAGS> v;
+        run.resume();
+        for (size_t j = 0 ; j < run.count() ; j++) {
+            const TYPE item = makeBenchmarkItem<TYPE>(rand());
+            v.add(&item);
+        }
+        run.pause();
+    }
+}
+
+// kChurnOps remove() and add() back of a random key, in a table of count
+template <template <typename, uint32_t> class VECTOR, typename TYPE, uint32_t FLAGS>
+void benchChurn(BenchmarkRun& run)
+{
+    VECTOR<TYPE, FLAGS> v;
+    fillEven(v, run.count());
+    srand(run.count());
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        run.resume();
+        for (size_t j = 0 ; j < kChurnOps ; j++) {
+            const TYPE item = makeBenchmarkItem<TYPE>(int32_t(rand() % run.count()) * 2);
+            v.remove(&item);
+            v.add(&item);
+        }
+        run.pause();
+    }
+    run.setCounter("ns_per_op", double(run.elapsed()) / run.iterations() / (kChurnOps * 2));
+}
+
+// indexOf() of count present keys, in random order
+template <template <typename, uint32_t> class VECTOR, typename TYPE, uint32_t FLAGS>
+void benchIndexOf(BenchmarkRun& run)
+{
+    VECTOR<TYPE, FLAGS> v;
+    fillEven(v, run.count());
+    srand(run.count());
+    size_t found = 0;
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        run.resume();
+        for (size_t j = 0 ; j < run.count() ; j++) {
+            const TYPE item = makeBenchmarkItem<TYPE>(int32_t(rand() % run.count()) * 2);
+            found += v.indexOf(&item) >= 0;
+        }
+        run.pause();
+    }
+    run.setCounter("ns_per_lookup", double(run.elapsed()) / run.iterations() / run.count());
+    run.setCounter("hit_ratio", double(found) / run.iterations() / run.count());
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchSortedAddRandom(BenchmarkRun& run)
+{
+    benchAddRandom<BenchmarkSortedVector, TYPE, FLAGS>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchChunkedAddRandom(BenchmarkRun& run)
+{
+    benchAddRandom<BenchmarkChunkedSortedVector, TYPE, FLAGS>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchSortedChurn(BenchmarkRun& run)
+{
+    benchChurn<BenchmarkSortedVector, TYPE, FLAGS>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchChunkedChurn(BenchmarkRun& run)
+{
+    benchChurn<BenchmarkChunkedSortedVector, TYPE, FLAGS>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchSortedIndexOf(BenchmarkRun& run)
+{
+    benchIndexOf<BenchmarkSortedVector, TYPE, FLAGS>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchChunkedIndexOf(BenchmarkRun& run)
+{
+    benchIndexOf<BenchmarkChunkedSortedVector, TYPE, FLAGS>(run);
+}
+
+const size_t kBuildCounts[] = { 256, 1024, 4096, 16384 };
+const size_t kTableCounts[] = { 256, 1024, 4096, 16384, 65536 };
+
+BENCHMARK_ALL_ITEMS(crossover_add_random_sorted, benchSortedAddRandom, kBuildCounts);
+BENCHMARK_ALL_ITEMS(crossover_add_random_chunked, benchChunkedAddRandom, kBuildCounts);
+BENCHMARK_ALL_ITEMS(crossover_churn_sorted, benchSortedChurn, kTableCounts);
+BENCHMARK_ALL_ITEMS(crossover_churn_chunked, benchChunkedChurn, kTableCounts);
+BENCHMARK_ALL_ITEMS(crossover_index_of_sorted, benchSortedIndexOf, kTableCounts);
+BENCHMARK_ALL_ITEMS(crossover_index_of_chunked, benchChunkedIndexOf, kTableCounts);
+
+} // namespace
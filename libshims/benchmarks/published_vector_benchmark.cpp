@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "Benchmark.h"
+#include "BenchmarkVector.h"
+#include "NV_PublishedVectorImpl.h"
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+const size_t kTableSize = 4096;
+const size_t kLookupsPerReader = 16384;
+const size_t kMaxReaders = 8;
+// the writer changes one item every millisecond
+const useconds_t kWriterPeriod = 1000;
+
+enum Sharing {
+    SHARING_MUTEX,      // lookups in the writer's vector, under a mutex
+    SHARING_RWLOCK,     // the same, under the read side of a rwlock
+    SHARING_READ,       // a fresh snapshot from read() per lookup
+    SHARING_REFRESH,    // a snapshot kept by each reader, refresh()ed per lookup
+};
+
+template <typename TYPE, uint32_t FLAGS>
+struct Table {
+    BenchmarkSortedVector<TYPE, FLAGS>  vector;
+    PublishedVectorImpl                 published;
+    pthread_mutex_t                     mutex;
+    pthread_rwlock_t                    rwlock;
+    pthread_barrier_t                   start;
+    Sharing                             sharing;
+    std::atomic<bool>                   done;
+    std::atomic<size_t>                 found;
+    size_t                              publishes;
+
+    Table() : published(vector), done(false), found(0), publishes(0) {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_rwlock_init(&rwlock, NULL);
+    }
+    ~Table() {
+        pthread_rwlock_destroy(&rwlock);
+        pthread_mutex_destroy(&mutex);
+    }
+};
+
+template <typename TYPE, uint32_t FLAGS>
+void* readerThread(void* arg)
+{
+    Table<TYPE, FLAGS>& table = *static_cast<Table<TYPE, FLAGS>*>(arg);
+    BenchmarkSortedVector<TYPE, FLAGS> snapshot;
+    uint64_t generation = 0;
+    unsigned int seed = unsigned(reinterpret_cast<uintptr_t>(&snapshot));
+    size_t found = 0;
+    pthread_barrier_wait(&table.start);
+    for (size_t i = 0 ; i < kLookupsPerReader ; i++) {
+        const TYPE key = makeBenchmarkItem<TYPE>(int32_t(rand_r(&seed) % kTableSize) * 2);
+        switch (table.sharing) {
+        case SHARING_MUTEX:
+            pthread_mutex_lock(&table.mutex);
+            found += table.vector.indexOf(&key) >= 0;
+            pthread_mutex_unlock(&table.mutex);
+            break;
+        case SHARING_RWLOCK:
+            pthread_rwlock_rdlock(&table.rwlock);
+            found += table.vector.indexOf(&key) >= 0;
+            pthread_rwlock_unlock(&table.rwlock);
+            break;
+        case SHARING_READ:
+            table.published.read(snapshot);
+            found += snapshot.indexOf(&key) >= 0;
+            break;
+        case SHARING_REFRESH:
+            table.published.refresh(snapshot, &generation);
+            found += snapshot.indexOf(&key) >= 0;
+            break;
+        }
+    }
+    table.found += found;
+    return 0;
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void* writerThread(void* arg)
+{
+    Table<TYPE, FLAGS>& table = *static_cast<Table<TYPE, FLAGS>*>(arg);
+    for (int32_t n = 0 ; !table.done.load(std::memory_order_relaxed) ; n++) {
+        usleep(kWriterPeriod);
+        // replaces an item with an equal one: the keys stay the same
+        const TYPE item = makeBenchmarkItem<TYPE>(int32_t(n % kTableSize) * 2);
+        switch (table.sharing) {
+        case SHARING_MUTEX:
+            pthread_mutex_lock(&table.mutex);
+            table.vector.add(&item);
+            pthread_mutex_unlock(&table.mutex);
+            break;
+        case SHARING_RWLOCK:
+            pthread_rwlock_wrlock(&table.rwlock);
+            table.vector.add(&item);
+            pthread_rwlock_unlock(&table.rwlock);
+            break;
+        case SHARING_READ:
+        case SHARING_REFRESH:
+            table.vector.add(&item);
+            table.published.publish();
+            break;
+        }
+        table.publishes++;
+    }
+    return 0;
+}
+
+// count reader threads doing kLookupsPerReader lookups each in a table of
+// kTableSize items, while a writer changes it
+template <typename TYPE, uint32_t FLAGS, Sharing SHARING>
+void benchShared(BenchmarkRun& run)
+{
+    const size_t readers = run.count() < kMaxReaders ? run.count() : kMaxReaders;
+    Table<TYPE, FLAGS> table;
+    table.sharing = SHARING;
+    for (size_t i = 0 ; i < kTableSize ; i++) {
+        const TYPE item = makeBenchmarkItem<TYPE>(int32_t(i * 2));
+        table.vector.add(&item);
+    }
+    table.published.publish();
+
+    size_t publishes = 0;
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        pthread_t threads[kMaxReaders + 1];
+        pthread_barrier_init(&table.start, NULL, unsigned(readers + 1));
+        table.done = false;
+        table.publishes = 0;
+        for (size_t r = 0 ; r < readers ; r++) {
+            pthread_create(&threads[r], NULL, readerThread<TYPE, FLAGS>, &table);
+        }
+        pthread_create(&threads[readers], NULL, writerThread<TYPE, FLAGS>, &table);
+        pthread_barrier_wait(&table.start);
+        run.resume();
+        for (size_t r = 0 ; r < readers ; r++) {
+            pthread_join(threads[r], NULL);
+        }
+        run.pause();
+        table.done = true;
+        pthread_join(threads[readers], NULL);
+        pthread_barrier_destroy(&table.start);
+        publishes += table.publishes;
+    }
+    const double lookups = double(run.iterations()) * readers * kLookupsPerReader;
+    run.setCounter("ns_per_lookup", double(run.elapsed()) / lookups);
+    run.setCounter("mlookups_per_s", lookups * 1000.0 / double(run.elapsed()));
+    run.setCounter("hit_ratio", double(table.found) / lookups);
+    run.setCounter("writes", double(publishes) / run.iterations());
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchSharedMutex(BenchmarkRun& run)
+{
+    benchShared<TYPE, FLAGS, SHARING_MUTEX>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchSharedRwlock(BenchmarkRun& run)
+{
+    benchShared<TYPE, FLAGS, SHARING_RWLOCK>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchSharedRead(BenchmarkRun& run)
+{
+    benchShared<TYPE, FLAGS, SHARING_READ>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchSharedRefresh(BenchmarkRun& run)
+{
+    benchShared<TYPE, FLAGS, SHARING_REFRESH>(run);
+}
+
+// reader threads
+const size_t kReaderCounts[] = { 1, 2, 4 };
+
+BENCHMARK_ITEM_FLAGS(shared_lookup_mutex, benchSharedMutex, kReaderCounts, 16);
+BENCHMARK_ITEM_FLAGS(shared_lookup_rwlock, benchSharedRwlock, kReaderCounts, 16);
+BENCHMARK_ITEM_FLAGS(shared_lookup_read, benchSharedRead, kReaderCounts, 16);
+BENCHMARK_ITEM_FLAGS(shared_lookup_refresh, benchSharedRefresh, kReaderCounts, 16);
+
+} // namespace
@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks that the versions of a PublishedVectorImpl go away exactly once,
+ * and only after the last reader is done with them: once with a reader
+ * held in the middle of read() while publish() replaces the version it
+ * pinned, then with readers that keep their pin until publish() has
+ * swapped the version out, and let go of it while publish() is still
+ * handing it over. The items count themselves, so a version freed twice or
+ * never shows at the end. Meant to run under ASan as well ("make
+ * SANITIZE=address test" in host/), which catches a version used after it
+ * was freed.
+ *
+ * Prints the failures, and exits with 1 if there were any.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <atomic>
+
+#include <utils/SharedBuffer.h>
+
+#include "BenchmarkVector.h"
+#include "NV_PublishedVectorImpl.h"
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+const size_t kItems = 16;
+const size_t kReaders = 4;
+const int32_t kRounds = 50000;
+
+std::atomic<int> gLive(0);
+size_t gFailures = 0;
+
+struct Item {
+    int32_t key;
+    Item() : key(0) { gLive++; }
+    Item(const Item& rhs) : key(rhs.key) { gLive++; }
+    ~Item() { gLive--; }
+};
+
+typedef BenchmarkVector<Item, kNoFlags> ItemVector;
+
+#define CHECK(cond, ...)                                                        \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            printf("FAILED: " __VA_ARGS__);                                     \
+            printf("\n");                                                       \
+            gFailures++;                                                        \
+        }                                                                       \
+    } while (0)
+
+void fill(ItemVector& vector, int32_t key)
+{
+    Item item;
+    item.key = key;
+    vector.clear();
+    for (size_t i = 0 ; i < kItems ; i++) {
+        vector.add(&item);
+    }
+}
+
+// the key of all the items of snapshot, or -1 if they don't agree
+int32_t keyOf(const ItemVector& snapshot)
+{
+    if (snapshot.size() != kItems) {
+        return -1;
+    }
+    for (size_t i = 1 ; i < kItems ; i++) {
+        if (snapshot[i].key != snapshot[0].key) {
+            return -1;
+        }
+    }
+    return snapshot[0].key;
+}
+
+// ---------------------------------------------------------------------------
+
+struct Race {
+    PublishedVectorImpl*    published;
+    std::atomic<bool>       done;
+};
+
+/*
+ * read() pins the published version while it takes a reference on its
+ * storage: the reader flagged with tHold stops right there until the
+ * writer is done publishing the next one, and the ones with a tRace wait
+ * for publish() to swap the version out.
+ */
+thread_local bool tHold = false;
+thread_local Race* tRace = 0;
+sem_t gPinned;
+sem_t gPublished;
+
+struct HeldReader {
+    PublishedVectorImpl*    published;
+    ItemVector              snapshot;
+};
+
+void* heldReaderThread(void* arg)
+{
+    HeldReader& reader = *static_cast<HeldReader*>(arg);
+    tHold = true;
+    reader.published->read(reader.snapshot);
+    tHold = false;
+    return 0;
+}
+
+void testPinAcrossPublish()
+{
+    sem_init(&gPinned, 0, 0);
+    sem_init(&gPublished, 0, 0);
+    {
+        ItemVector vector;
+        PublishedVectorImpl published(vector);
+        fill(vector, 1);
+        published.publish();
+
+        HeldReader reader;
+        reader.published = &published;
+        pthread_t thread;
+        pthread_create(&thread, NULL, heldReaderThread, &reader);
+
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 5;
+        int err;
+        while ((err = sem_timedwait(&gPinned, &deadline)) && errno == EINTR) {
+        }
+        CHECK(!err, "the reader never stopped in read(): is SharedBuffer::acquire() "
+                "interposed?");
+
+        // replaces the version the reader has pinned, and drops the
+        // writer's own reference to its storage
+        fill(vector, 2);
+        published.publish();
+        fill(vector, 3);
+        sem_post(&gPublished);
+        pthread_join(thread, NULL);
+
+        CHECK(keyOf(reader.snapshot) == 1, "held reader got key %d instead of 1",
+                keyOf(reader.snapshot));
+        ItemVector snapshot;
+        published.read(snapshot);
+        CHECK(keyOf(snapshot) == 2, "reader after publish() got key %d instead of 2",
+                keyOf(snapshot));
+    }
+    sem_destroy(&gPublished);
+    sem_destroy(&gPinned);
+    CHECK(gLive == 0, "%d items left after the held reader", gLive.load());
+}
+
+// ---------------------------------------------------------------------------
+
+void* racingReaderThread(void* arg)
+{
+    Race& race = *static_cast<Race*>(arg);
+    tRace = &race;
+    ItemVector snapshot;
+    int32_t last = 0;
+    uint64_t generation = 0;
+    for (size_t n = 0 ; !race.done.load(std::memory_order_relaxed) ; n++) {
+        if (n & 1) {
+            race.published->read(snapshot);
+        } else if (!race.published->refresh(snapshot, &generation)) {
+            continue;
+        }
+        const int32_t key = keyOf(snapshot);
+        if (key < last) {
+            printf("FAILED: racing reader got key %d after %d\n", key, last);
+            gFailures++;
+            break;
+        }
+        last = key;
+    }
+    return 0;
+}
+
+void testRacingReaders()
+{
+    {
+        ItemVector vector;
+        PublishedVectorImpl published(vector);
+        fill(vector, 1);
+        published.publish();
+
+        Race race;
+        race.published = &published;
+        race.done = false;
+        pthread_t threads[kReaders];
+        for (size_t i = 0 ; i < kReaders ; i++) {
+            pthread_create(&threads[i], NULL, racingReaderThread, &race);
+        }
+        for (int32_t round = 2 ; round <= kRounds ; round++) {
+            fill(vector, round);
+            published.publish();
+        }
+        race.done = true;
+        for (size_t i = 0 ; i < kReaders ; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    CHECK(gLive == 0, "%d items left after the racing readers", gLive.load());
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+
+// stands in for the process' own, to stop the held reader while it's pinned
+void SharedBuffer::acquire() const
+{
+    mRefs.fetch_add(1, std::memory_order_relaxed);
+    if (tHold) {
+        tHold = false;
+        sem_post(&gPinned);
+        while (sem_wait(&gPublished) && errno == EINTR) {
+        }
+    } else if (tRace) {
+        // publish() bumps the generation right after the swap, and hands
+        // the pins over right after that
+        const uint64_t generation = tRace->published->generation();
+        while (tRace->published->generation() == generation &&
+                !tRace->done.load(std::memory_order_relaxed)) {
+        }
+    }
+}
+
+}; // namespace android
+
+int main()
+{
+    testPinAcrossPublish();
+    testRacingReaders();
+    printf("%zu failed\n", gFailures);
+    return gFailures ? 1 : 0;
+}
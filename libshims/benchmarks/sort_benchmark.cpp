@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <atomic>
+
+#include "Benchmark.h"
+#include "BenchmarkVector.h"
+#include "NV_VectorWorkers.h"
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+enum Pattern {
+    PATTERN_RANDOM,
+    PATTERN_SORTED,
+    PATTERN_REVERSED,
+    PATTERN_NEARLY_SORTED,
+};
+
+// large sorts run on the workers too, see VECTORIMPL_SORT_PARALLEL_MIN
+struct CompareState {
+    std::atomic<size_t> compares;
+};
+
+template <typename TYPE>
+int compareItems(const void* lhs, const void* rhs, void* state)
+{
+    static_cast<CompareState*>(state)->compares.fetch_add(1, std::memory_order_relaxed);
+    return BenchmarkTypeOps<TYPE>::compare(lhs, rhs);
+}
+
+template <typename TYPE>
+int compareItemsOnly(const void* lhs, const void* rhs, void*)
+{
+    return BenchmarkTypeOps<TYPE>::compare(lhs, rhs);
+}
+
+int32_t makeKey(Pattern pattern, size_t i, size_t count)
+{
+    switch (pattern) {
+        case PATTERN_RANDOM:
+            return rand();
+        case PATTERN_SORTED:
+            return int32_t(i);
+        case PATTERN_REVERSED:
+            return int32_t(count - i);
+        case PATTERN_NEARLY_SORTED:
+            // roughly one item in fifty is out of place
+            return (rand() % 50) ? int32_t(i) : rand() % int32_t(count);
+    }
+    return 0;
+}
+
+enum Algorithm {
+    ALGORITHM_MERGE,    // sort() with a counting comparator
+    ALGORITHM_RADIX,    // radixSort() on the key
+    ALGORITHM_PLAIN,    // sort() with a comparator that only compares
+};
+
+template <typename TYPE, uint32_t FLAGS>
+void benchSort(BenchmarkRun& run, Pattern pattern, Algorithm algorithm = ALGORITHM_MERGE)
+{
+    const size_t count = run.count();
+    BenchmarkVector<TYPE, FLAGS> input;
+    srand(count);
+    for (size_t i = 0 ; i < count ; i++) {
+        TYPE item = makeBenchmarkItem<TYPE>(makeKey(pattern, i, count));
+        input.add(&item);
+    }
+
+    CompareState state;
+    state.compares = 0;
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        // sorting a copy-on-write clone includes the copy in the measurement,
+        // exactly like the blobs sorting a vector they got from somewhere else
+        BenchmarkVector<TYPE, FLAGS> v(input);
+        run.resume();
+        switch (algorithm) {
+            case ALGORITHM_MERGE:
+                v.sort(compareItems<TYPE>, &state);
+                break;
+            case ALGORITHM_RADIX:
+                v.radixSort(offsetof(TYPE, key), sizeof(int32_t), true);
+                break;
+            case ALGORITHM_PLAIN:
+                v.sort(compareItemsOnly<TYPE>, NULL);
+                break;
+        }
+        run.pause();
+    }
+    if (algorithm == ALGORITHM_MERGE) {
+        run.setCounter("compares", double(state.compares) / run.iterations());
+    }
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void sortRandom(BenchmarkRun& run) {
+    benchSort<TYPE, FLAGS>(run, PATTERN_RANDOM);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void sortSorted(BenchmarkRun& run) {
+    benchSort<TYPE, FLAGS>(run, PATTERN_SORTED);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void sortReversed(BenchmarkRun& run) {
+    benchSort<TYPE, FLAGS>(run, PATTERN_REVERSED);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void sortNearlySorted(BenchmarkRun& run) {
+    benchSort<TYPE, FLAGS>(run, PATTERN_NEARLY_SORTED);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void sortRandomLarge(BenchmarkRun& run) {
+    benchSort<TYPE, FLAGS>(run, PATTERN_RANDOM);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void radixSortRandom(BenchmarkRun& run) {
+    benchSort<TYPE, FLAGS>(run, PATTERN_RANDOM, ALGORITHM_RADIX);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void radixSortNearlySorted(BenchmarkRun& run) {
+    benchSort<TYPE, FLAGS>(run, PATTERN_NEARLY_SORTED, ALGORITHM_RADIX);
+}
+
+// with VECTORIMPL_WORKERS=1 for the serial baseline
+template <typename TYPE, uint32_t FLAGS>
+void sortRandomParallel(BenchmarkRun& run) {
+    benchSort<TYPE, FLAGS>(run, PATTERN_RANDOM, ALGORITHM_PLAIN);
+    const size_t min = VectorWorkers::sortParallelMin();
+    run.setCounter("threads", (min && run.count() >= min) ? VectorWorkers::concurrency() : 1);
+}
+
+const size_t kSortCounts[] = { 16, 256, 4096, 16384 };
+const size_t kRadixCounts[] = { 256, 4096, 16384, 65536 };
+const size_t kParallelCounts[] = { 4096, 16384, 65536, 262144 };
+
+BENCHMARK_ALL_ITEMS(sort_random, sortRandom, kSortCounts);
+BENCHMARK_ALL_ITEMS(sort_sorted, sortSorted, kSortCounts);
+BENCHMARK_ALL_ITEMS(sort_reversed, sortReversed, kSortCounts);
+BENCHMARK_ALL_ITEMS(sort_nearly_sorted, sortNearlySorted, kSortCounts);
+
+// radixSort() against sort() with a comparator, on the same inputs
+BENCHMARK_COPYABLE_ITEMS(sort_random_large, sortRandomLarge, kRadixCounts);
+BENCHMARK_COPYABLE_ITEMS(radix_sort_random, radixSortRandom, kRadixCounts);
+BENCHMARK_COPYABLE_ITEMS(radix_sort_nearly_sorted, radixSortNearlySorted, kRadixCounts);
+
+BENCHMARK_ALL_ITEMS(sort_random_parallel, sortRandomParallel, kParallelCounts);
+
+} // namespace
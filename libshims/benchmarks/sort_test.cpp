@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the output of sort(), radixSort() and editBatch() against plain
+ * std:: implementations, on the inputs of sort_benchmark.cpp and with
+ * duplicate keys: every item remembers where it came from, so a sort that
+ * isn't stable shows. Counts go around sortParallelMin(), so the same
+ * binary run with VECTORIMPL_WORKERS=1 checks the serial sort and with
+ * more workers the parallel one (see "make test" in host/Makefile).
+ *
+ * Prints the failures, and exits with 1 if there were any.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Benchmark.h"
+#include "BenchmarkVector.h"
+#include "NV_VectorWorkers.h"
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+typedef BenchmarkItem<16> Item;
+
+enum Pattern {
+    PATTERN_RANDOM,
+    PATTERN_REVERSED,
+    PATTERN_NEARLY_SORTED,
+    PATTERN_DUPLICATES,     // an eighth as many keys as items
+    NUM_PATTERNS
+};
+
+const char* const kPatternNames[NUM_PATTERNS] = {
+    "random", "reversed", "nearly_sorted", "duplicates"
+};
+
+size_t gChecks = 0;
+size_t gFailures = 0;
+
+int32_t makeKey(Pattern pattern, size_t i, size_t count)
+{
+    switch (pattern) {
+        case PATTERN_RANDOM:
+            // negative ones too, for the signed radix sort
+            return rand() - RAND_MAX / 2;
+        case PATTERN_REVERSED:
+            return int32_t(count - i);
+        case PATTERN_NEARLY_SORTED:
+            return (rand() % 50) ? int32_t(i) : rand() % int32_t(count);
+        case PATTERN_DUPLICATES:
+            return rand() % int32_t(count / 8 + 1);
+        case NUM_PATTERNS:
+            break;
+    }
+    return 0;
+}
+
+// payload[0] is the position of the item in the input
+std::vector<Item> makeInput(Pattern pattern, size_t count)
+{
+    std::vector<Item> items;
+    for (size_t i = 0 ; i < count ; i++) {
+        Item item = makeBenchmarkItem<Item>(makeKey(pattern, i, count));
+        item.payload[0] = int32_t(i);
+        items.push_back(item);
+    }
+    return items;
+}
+
+bool lessKey(const Item& lhs, const Item& rhs)
+{
+    return lhs.key < rhs.key;
+}
+
+int compareItems(const void* lhs, const void* rhs, void*)
+{
+    return BenchmarkTypeOps<Item>::compare(lhs, rhs);
+}
+
+template <typename VECTOR>
+void check(const char* what, const char* input, size_t count, const VECTOR& vector,
+        const std::vector<Item>& expected)
+{
+    gChecks++;
+    if (vector.size() != expected.size()) {
+        printf("FAILED: %s of %zu %s items: %zu items instead of %zu\n", what, count, input,
+                vector.size(), expected.size());
+        gFailures++;
+        return;
+    }
+    for (size_t i = 0 ; i < expected.size() ; i++) {
+        if (vector[i].key != expected[i].key || vector[i].payload[0] != expected[i].payload[0]) {
+            printf("FAILED: %s of %zu %s items: item %zu is %d from %d, expected %d from %d\n",
+                    what, count, input, i, vector[i].key, vector[i].payload[0],
+                    expected[i].key, expected[i].payload[0]);
+            gFailures++;
+            return;
+        }
+    }
+}
+
+template <uint32_t FLAGS>
+void testSort(const char* flags, Pattern pattern, size_t count)
+{
+    const std::vector<Item> input = makeInput(pattern, count);
+    std::vector<Item> expected(input);
+    std::stable_sort(expected.begin(), expected.end(), lessKey);
+
+    char what[64];
+    BenchmarkVector<Item, FLAGS> v;
+    for (size_t i = 0 ; i < count ; i++) {
+        v.add(&input[i]);
+    }
+    // sorting a clone, which has to copy the storage first
+    BenchmarkVector<Item, FLAGS> sorted(v);
+    sorted.sort(compareItems, NULL);
+    snprintf(what, sizeof(what), "sort/%s", flags);
+    check(what, kPatternNames[pattern], count, sorted, expected);
+
+    if (FLAGS & VectorImpl::HAS_TRIVIAL_COPY) {
+        BenchmarkVector<Item, FLAGS> radix(v);
+        radix.radixSort(offsetof(Item, key), sizeof(int32_t), true);
+        snprintf(what, sizeof(what), "radixSort/%s", flags);
+        check(what, kPatternNames[pattern], count, radix, expected);
+    }
+}
+
+// removes and inserts at random places, against the same edits made one
+// position of the input at a time
+template <uint32_t FLAGS>
+void testEditBatch(const char* flags, size_t count)
+{
+    const std::vector<Item> input = makeInput(PATTERN_RANDOM, count);
+    std::vector<VectorImpl::Removal> removals;
+    std::vector<VectorImpl::Insertion> insertions;
+    std::vector<Item> inserted;
+    inserted.reserve(count + 1);
+
+    for (size_t i = 0 ; i < count ; ) {
+        const size_t length = rand() % 8 + 1;
+        if (rand() % 4 == 0 && i + length <= count) {
+            VectorImpl::Removal removal = { i, length };
+            removals.push_back(removal);
+        }
+        i += length;
+    }
+    for (size_t i = 0 ; i <= count ; i++) {
+        if (rand() % 4 == 0) {
+            Item item = makeBenchmarkItem<Item>(rand());
+            item.payload[0] = -1 - int32_t(inserted.size());
+            inserted.push_back(item);
+            VectorImpl::Insertion insertion = { i, &inserted.back(), 1 };
+            insertions.push_back(insertion);
+        }
+    }
+
+    std::vector<Item> expected;
+    size_t r = 0;
+    size_t n = 0;
+    for (size_t i = 0 ; i <= count ; i++) {
+        while (n < insertions.size() && insertions[n].index == i) {
+            expected.push_back(*static_cast<const Item*>(insertions[n++].items));
+        }
+        if (r < removals.size() && i >= removals[r].index + removals[r].count) {
+            r++;
+        }
+        const bool removed = r < removals.size() && i >= removals[r].index;
+        if (i < count && !removed) {
+            expected.push_back(input[i]);
+        }
+    }
+
+    BenchmarkVector<Item, FLAGS> v;
+    for (size_t i = 0 ; i < count ; i++) {
+        v.add(&input[i]);
+    }
+    v.editBatch(insertions.data(), insertions.size(), removals.data(), removals.size());
+    char what[64];
+    snprintf(what, sizeof(what), "editBatch/%s", flags);
+    check(what, "random", count, v, expected);
+}
+
+template <uint32_t FLAGS>
+void testAll(const char* flags, const std::vector<size_t>& counts)
+{
+    for (size_t c = 0 ; c < counts.size() ; c++) {
+        for (int p = 0 ; p < NUM_PATTERNS ; p++) {
+            srand(unsigned(counts[c] * NUM_PATTERNS + p));
+            testSort<FLAGS>(flags, Pattern(p), counts[c]);
+        }
+        testEditBatch<FLAGS>(flags, counts[c]);
+    }
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+
+int main()
+{
+    std::vector<size_t> counts;
+    const size_t small[] = { 0, 1, 2, 3, 31, 32, 33, 64, 65, 1000 };
+    counts.assign(small, small + sizeof(small) / sizeof(small[0]));
+    const size_t min = VectorWorkers::sortParallelMin();
+    if (min) {
+        // either side of the split, and the uneven ones
+        counts.push_back(min - 1);
+        counts.push_back(min);
+        counts.push_back(min + 1);
+        counts.push_back(min * 2 + 7);
+        counts.push_back(min * 3 + 1);
+    } else {
+        counts.push_back(16383);
+        counts.push_back(16385);
+    }
+    printf("sortParallelMin %zu, %zu threads\n", min, VectorWorkers::concurrency());
+
+    testAll<kPodFlags>("pod", counts);
+    testAll<kCopyFlags>("copy", counts);
+    testAll<kMoveFlags>("move", counts);
+    testAll<kNoFlags>("none", counts);
+
+    printf("%zu checks, %zu failed\n", gChecks, gFailures);
+    return gFailures ? 1 : 0;
+}
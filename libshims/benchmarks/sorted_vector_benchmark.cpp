@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Benchmark.h"
+#include "BenchmarkVector.h"
+#include "NV_SortedVectorHashIndex.h"
+#include "NV_SortedVectorSnapshot.h"
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// count even keys, so that odd keys can be used for misses and interleaving
+template <typename TYPE, uint32_t FLAGS>
+void fillEven(BenchmarkSortedVector<TYPE, FLAGS>& v, size_t count)
+{
+    BenchmarkVector<TYPE, FLAGS> items;
+    for (size_t i = 0 ; i < count ; i++) {
+        TYPE item = makeBenchmarkItem<TYPE>(int32_t(i * 2));
+        items.add(&item);
+    }
+    v.merge(static_cast<const VectorImpl&>(items));
+}
+
+enum Lookup {
+    LOOKUP_EACH,    // indexOf() per key
+    LOOKUP_BATCH,   // one indexOfBatch()
+    LOOKUP_KEYS,    // one indexOfKeys<int32_t>()
+    LOOKUP_HASH,    // SortedVectorHashIndex::indexOf() per key
+};
+
+template <typename TYPE>
+uint32_t hashKey(const void* item)
+{
+    return reinterpret_cast<const TYPE*>(item)->key;
+}
+
+// count present keys, in random order or sorted, looked up as told
+template <typename TYPE, uint32_t FLAGS, Lookup LOOKUP, bool SORTED>
+void benchLookup(BenchmarkRun& run)
+{
+    BenchmarkSortedVector<TYPE, FLAGS> v;
+    BenchmarkVector<TYPE, FLAGS> keys;
+    fillEven(v, run.count());
+    srand(run.count());
+    for (size_t i = 0 ; i < run.count() ; i++) {
+        const int32_t key = SORTED ? int32_t(i * 2) : int32_t(rand() % run.count()) * 2;
+        const TYPE item = makeBenchmarkItem<TYPE>(key);
+        keys.add(&item);
+    }
+    int32_t* keyValues = new int32_t[run.count()];
+    ssize_t* indices = new ssize_t[run.count()];
+    SortedVectorHashIndex hashIndex(v, hashKey<TYPE>);
+    hashIndex.indexOf(&keys[0]);
+    for (size_t i = 0 ; i < run.count() ; i++) {
+        keyValues[i] = keys[i].key;
+    }
+    size_t found = 0;
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        run.resume();
+        switch (LOOKUP) {
+        case LOOKUP_EACH:
+            for (size_t j = 0 ; j < keys.size() ; j++) {
+                indices[j] = v.indexOf(&keys[j]);
+            }
+            break;
+        case LOOKUP_BATCH:
+            v.indexOfBatch(keys.arrayImpl(), keys.size(), indices);
+            break;
+        case LOOKUP_KEYS:
+            v.indexOfKeys(keyValues, run.count(), indices);
+            break;
+        case LOOKUP_HASH:
+            for (size_t j = 0 ; j < keys.size() ; j++) {
+                indices[j] = hashIndex.indexOf(&keys[j]);
+            }
+            break;
+        }
+        run.pause();
+        for (size_t j = 0 ; j < run.count() ; j++) {
+            found += indices[j] >= 0;
+        }
+    }
+    delete[] keyValues;
+    delete[] indices;
+    run.setCounter("ns_per_lookup", double(run.elapsed()) / run.iterations() / run.count());
+    run.setCounter("hit_ratio", double(found) / run.iterations() / run.count());
+    if (LOOKUP == LOOKUP_HASH) {
+        SortedVectorHashIndex::Stats stats;
+        hashIndex.getStats(&stats);
+        run.setCounter("index_bytes_per_item", double(stats.bytes) / stats.items);
+    }
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchIndexOf(BenchmarkRun& run)
+{
+    benchLookup<TYPE, FLAGS, LOOKUP_EACH, false>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchIndexOfBatch(BenchmarkRun& run)
+{
+    benchLookup<TYPE, FLAGS, LOOKUP_BATCH, false>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchIndexOfKeys(BenchmarkRun& run)
+{
+    benchLookup<TYPE, FLAGS, LOOKUP_KEYS, false>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchIndexOfHash(BenchmarkRun& run)
+{
+    benchLookup<TYPE, FLAGS, LOOKUP_HASH, false>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchIndexOfSorted(BenchmarkRun& run)
+{
+    benchLookup<TYPE, FLAGS, LOOKUP_EACH, true>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchIndexOfBatchSorted(BenchmarkRun& run)
+{
+    benchLookup<TYPE, FLAGS, LOOKUP_BATCH, true>(run);
+}
+
+// add() of count random keys into an empty vector
+template <typename TYPE, uint32_t FLAGS>
+void benchAddRandom(BenchmarkRun& run)
+{
+    srand(run.count());
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkSortedVector<TYPE, FLAGS> v;
+        run.resume();
+        for (size_t j = 0 ; j < run.count() ; j++) {
+            const TYPE item = makeBenchmarkItem<TYPE>(rand());
+            v.add(&item);
+        }
+        run.pause();
+    }
+}
+
+// add() of count increasing keys into an empty vector
+template <typename TYPE, uint32_t FLAGS>
+void benchAddAscending(BenchmarkRun& run)
+{
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkSortedVector<TYPE, FLAGS> v;
+        run.resume();
+        for (size_t j = 0 ; j < run.count() ; j++) {
+            const TYPE item = makeBenchmarkItem<TYPE>(int32_t(j));
+            v.add(&item);
+        }
+        run.pause();
+    }
+}
+
+// add() of count jittered increasing keys into an empty vector: most of
+// them land up to 16 items before the end, optionally passing the index
+// of the previous one as a hint
+template <typename TYPE, uint32_t FLAGS, bool HINT>
+void benchAddNear(BenchmarkRun& run)
+{
+    srand(run.count());
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkSortedVector<TYPE, FLAGS> v;
+        ssize_t hint = 0;
+        run.resume();
+        for (size_t j = 0 ; j < run.count() ; j++) {
+            const TYPE item = makeBenchmarkItem<TYPE>(int32_t(j * 4 + rand() % 64));
+            hint = HINT ? v.add(&item, hint) : v.add(&item);
+        }
+        run.pause();
+    }
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchAddNearEach(BenchmarkRun& run)
+{
+    benchAddNear<TYPE, FLAGS, false>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchAddNearHinted(BenchmarkRun& run)
+{
+    benchAddNear<TYPE, FLAGS, true>(run);
+}
+
+// merge() of two interleaved sorted vectors of count items each
+template <typename TYPE, uint32_t FLAGS>
+void benchMergeSorted(BenchmarkRun& run)
+{
+    BenchmarkSortedVector<TYPE, FLAGS> input;
+    BenchmarkSortedVector<TYPE, FLAGS> other;
+    fillEven(input, run.count());
+    for (size_t i = 0 ; i < run.count() ; i++) {
+        TYPE item = makeBenchmarkItem<TYPE>(int32_t(i * 2 + 1));
+        other.add(&item);
+    }
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkSortedVector<TYPE, FLAGS> v(input);
+        run.resume();
+        v.merge(static_cast<const SortedVectorImpl&>(other));
+        run.pause();
+    }
+}
+
+// merge() of count unsorted items into a sorted vector of count items
+template <typename TYPE, uint32_t FLAGS>
+void benchMergeUnsorted(BenchmarkRun& run)
+{
+    BenchmarkSortedVector<TYPE, FLAGS> input;
+    BenchmarkVector<TYPE, FLAGS> other;
+    fillEven(input, run.count());
+    srand(run.count());
+    for (size_t i = 0 ; i < run.count() ; i++) {
+        TYPE item = makeBenchmarkItem<TYPE>(rand());
+        other.add(&item);
+    }
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkSortedVector<TYPE, FLAGS> v(input);
+        run.resume();
+        v.merge(static_cast<const VectorImpl&>(other));
+        run.pause();
+    }
+}
+
+#ifdef __ANDROID__
+const char kSnapshotDir[] = "/data/local/tmp";
+#else
+const char kSnapshotDir[] = "/tmp";
+#endif
+
+// the start of a service, rebuilding its table of count items from
+// scratch, or getting it from a snapshot, then looking up one of them
+template <typename TYPE, uint32_t FLAGS, bool SNAPSHOT>
+void benchStartup(BenchmarkRun& run)
+{
+    BenchmarkVector<TYPE, FLAGS> items;
+    srand(run.count());
+    for (size_t i = 0 ; i < run.count() ; i++) {
+        TYPE item = makeBenchmarkItem<TYPE>(rand());
+        items.add(&item);
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/vectorimpl-bench-%d.snap", kSnapshotDir, getpid());
+    if (SNAPSHOT) {
+        BenchmarkSortedVector<TYPE, FLAGS> v;
+        v.merge(static_cast<const VectorImpl&>(items));
+        SortedVectorSnapshot::write(v, path, sizeof(TYPE));
+    }
+    size_t found = 0;
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        SortedVectorSnapshot snapshot;
+        BenchmarkSortedVector<TYPE, FLAGS> v;
+        run.resume();
+        if (SNAPSHOT) {
+            if (snapshot.open(path, sizeof(TYPE)) == NO_ERROR) {
+                snapshot.attach(v);
+            }
+        } else {
+            v.merge(static_cast<const VectorImpl&>(items));
+        }
+        found += v.indexOf(&items[i % run.count()]) >= 0;
+        run.pause();
+    }
+    if (SNAPSHOT) {
+        unlink(path);
+    }
+    run.setCounter("hit_ratio", double(found) / run.iterations());
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchStartupRebuild(BenchmarkRun& run)
+{
+    benchStartup<TYPE, FLAGS, false>(run);
+}
+
+template <typename TYPE, uint32_t FLAGS>
+void benchStartupSnapshot(BenchmarkRun& run)
+{
+    benchStartup<TYPE, FLAGS, true>(run);
+}
+
+const size_t kLookupCounts[] = { 16, 256, 4096, 65536 };
+const size_t kBuildCounts[] = { 16, 256, 4096 };
+const size_t kStartupCounts[] = { 4096, 65536, 1048576 };
+
+BENCHMARK_ALL_ITEMS(sorted_index_of, benchIndexOf, kLookupCounts);
+BENCHMARK_ALL_ITEMS(sorted_index_of_batch, benchIndexOfBatch, kLookupCounts);
+BENCHMARK_ALL_ITEMS(sorted_index_of_keys, benchIndexOfKeys, kLookupCounts);
+BENCHMARK_ALL_ITEMS(sorted_index_of_hash, benchIndexOfHash, kLookupCounts);
+BENCHMARK_ALL_ITEMS(sorted_index_of_sorted, benchIndexOfSorted, kLookupCounts);
+BENCHMARK_ALL_ITEMS(sorted_index_of_batch_sorted, benchIndexOfBatchSorted, kLookupCounts);
+BENCHMARK_ALL_ITEMS(sorted_add_random, benchAddRandom, kBuildCounts);
+BENCHMARK_ALL_ITEMS(sorted_add_ascending, benchAddAscending, kBuildCounts);
+BENCHMARK_ALL_ITEMS(sorted_add_near, benchAddNearEach, kBuildCounts);
+BENCHMARK_ALL_ITEMS(sorted_add_near_hinted, benchAddNearHinted, kBuildCounts);
+BENCHMARK_ALL_ITEMS(sorted_merge_sorted, benchMergeSorted, kBuildCounts);
+BENCHMARK_ALL_ITEMS(sorted_merge_unsorted, benchMergeUnsorted, kBuildCounts);
+BENCHMARK_COPYABLE_ITEMS(sorted_startup_rebuild, benchStartupRebuild, kStartupCounts);
+BENCHMARK_COPYABLE_ITEMS(sorted_startup_snapshot, benchStartupSnapshot, kStartupCounts);
+
+} // namespace
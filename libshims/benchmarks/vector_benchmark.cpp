@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Benchmark.h"
+#include "BenchmarkVector.h"
+#include "NV_VectorPolicy.h"
+#include "NV_VectorReclaimer.h"
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// push() count items into an empty vector, growing it as the blobs do
+template <typename TYPE, uint32_t FLAGS>
+void benchPush(BenchmarkRun& run)
+{
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v;
+        run.resume();
+        for (size_t j = 0 ; j < run.count() ; j++) {
+            v.push(&item);
+        }
+        run.pause();
+    }
+}
+
+// insertAt() at the front, which moves the whole tail every time
+template <typename TYPE, uint32_t FLAGS>
+void benchInsertFront(BenchmarkRun& run)
+{
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v;
+        run.resume();
+        for (size_t j = 0 ; j < run.count() ; j++) {
+            v.insertAt(&item, 0);
+        }
+        run.pause();
+    }
+}
+
+// insertAt() in the middle
+template <typename TYPE, uint32_t FLAGS>
+void benchInsertMiddle(BenchmarkRun& run)
+{
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v;
+        run.resume();
+        for (size_t j = 0 ; j < run.count() ; j++) {
+            v.insertAt(&item, v.size() / 2);
+        }
+        run.pause();
+    }
+}
+
+// insertAt() near the end, so each insert moves a couple of items
+template <typename TYPE, uint32_t FLAGS>
+void benchInsertNearEnd(BenchmarkRun& run)
+{
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v;
+        v.insertAt(&item, 0, 2);
+        run.resume();
+        for (size_t j = 0 ; j < run.count() ; j++) {
+            v.insertAt(&item, v.size() - 2);
+        }
+        run.pause();
+    }
+}
+
+// insertAt() of count copies of an item, which splats them in one go
+template <typename TYPE, uint32_t FLAGS>
+void benchSplat(BenchmarkRun& run)
+{
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v;
+        v.setCapacity(run.count());
+        run.resume();
+        v.insertAt(&item, 0, run.count());
+        run.pause();
+    }
+}
+
+// removeItemsAt() from the front until the vector is empty
+template <typename TYPE, uint32_t FLAGS>
+void benchRemoveFront(BenchmarkRun& run)
+{
+    BenchmarkVector<TYPE, FLAGS> input;
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    input.insertAt(&item, 0, run.count());
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v(input);
+        v.editArrayImpl();
+        run.resume();
+        while (!v.isEmpty()) {
+            v.removeItemsAt(0);
+        }
+        run.pause();
+    }
+}
+
+// pop() from the back until the vector is empty, shrinking as it goes
+template <typename TYPE, uint32_t FLAGS>
+void benchPop(BenchmarkRun& run)
+{
+    BenchmarkVector<TYPE, FLAGS> input;
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    input.insertAt(&item, 0, run.count());
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v(input);
+        v.editArrayImpl();
+        run.resume();
+        while (!v.isEmpty()) {
+            v.pop();
+        }
+        run.pause();
+    }
+}
+
+// replaceAt() every item, one editArrayImpl() per item
+template <typename TYPE, uint32_t FLAGS>
+void benchReplaceEach(BenchmarkRun& run)
+{
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    const TYPE other = makeBenchmarkItem<TYPE>(2);
+    BenchmarkVector<TYPE, FLAGS> v;
+    v.insertAt(&item, 0, run.count());
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        const TYPE* replacement = (i & 1) ? &item : &other;
+        run.resume();
+        for (size_t j = 0 ; j < run.count() ; j++) {
+            v.replaceAt(replacement, j);
+        }
+        run.pause();
+    }
+}
+
+// the same writes through a single editItemRange()
+template <typename TYPE, uint32_t FLAGS>
+void benchEditRange(BenchmarkRun& run)
+{
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    const TYPE other = makeBenchmarkItem<TYPE>(2);
+    BenchmarkVector<TYPE, FLAGS> v;
+    v.insertAt(&item, 0, run.count());
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        const TYPE& replacement = (i & 1) ? item : other;
+        run.resume();
+        TYPE* items = static_cast<TYPE*>(v.editItemRange(0, run.count()));
+        for (size_t j = 0 ; j < run.count() ; j++) {
+            items[j] = replacement;
+        }
+        run.pause();
+    }
+}
+
+// the same items written by one replaceArrayAt()
+template <typename TYPE, uint32_t FLAGS>
+void benchReplaceArray(BenchmarkRun& run)
+{
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    const TYPE other = makeBenchmarkItem<TYPE>(2);
+    BenchmarkVector<TYPE, FLAGS> v, items, others;
+    v.insertAt(&item, 0, run.count());
+    items.insertAt(&item, 0, run.count());
+    others.insertAt(&other, 0, run.count());
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        const VectorImpl& replacement = (i & 1) ? items : others;
+        run.resume();
+        v.replaceArrayAt(replacement.arrayImpl(), 0, run.count());
+        run.pause();
+    }
+}
+
+// hands a vector over through a temporary, the way copies do it
+template <typename TYPE, uint32_t FLAGS>
+void benchCopyHandOver(BenchmarkRun& run)
+{
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    BenchmarkVector<TYPE, FLAGS> v;
+    v.insertAt(&item, 0, run.count());
+    run.resume();
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> tmp(v);
+        v.clear();
+        v = tmp;
+        tmp.clear();
+    }
+    run.pause();
+}
+
+// ...and the way moves do it
+template <typename TYPE, uint32_t FLAGS>
+void benchMoveHandOver(BenchmarkRun& run)
+{
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    BenchmarkVector<TYPE, FLAGS> v;
+    v.insertAt(&item, 0, run.count());
+    run.resume();
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> tmp(static_cast<BenchmarkVector<TYPE, FLAGS>&&>(v));
+        v = static_cast<BenchmarkVector<TYPE, FLAGS>&&>(tmp);
+    }
+    run.pause();
+}
+
+const size_t kScatteredEdits = 16;
+
+// inserts one item at each of kScatteredEdits spread out positions, then
+// removes kScatteredEdits others, one call per position
+template <typename TYPE, uint32_t FLAGS>
+void benchScatteredEach(BenchmarkRun& run)
+{
+    BenchmarkVector<TYPE, FLAGS> input;
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    input.insertAt(&item, 0, run.count());
+    const size_t stride = run.count() / kScatteredEdits;
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v(input);
+        v.editArrayImpl();
+        run.resume();
+        // back to front, so that the indices stay those of the input
+        for (size_t j = kScatteredEdits ; j-- > 0 ; ) {
+            v.insertAt(&item, j*stride);
+        }
+        for (size_t j = kScatteredEdits ; j-- > 0 ; ) {
+            v.removeItemsAt(j*(stride + 1) + stride/2 + 1);
+        }
+        run.pause();
+    }
+}
+
+// ...and with a single editBatch()
+template <typename TYPE, uint32_t FLAGS>
+void benchScatteredBatch(BenchmarkRun& run)
+{
+    BenchmarkVector<TYPE, FLAGS> input;
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    input.insertAt(&item, 0, run.count());
+    const size_t stride = run.count() / kScatteredEdits;
+    VectorImpl::Insertion insertions[kScatteredEdits];
+    VectorImpl::Removal removals[kScatteredEdits];
+    for (size_t j = 0 ; j < kScatteredEdits ; j++) {
+        insertions[j].index = j*stride;
+        insertions[j].items = &item;
+        insertions[j].count = 1;
+        removals[j].index = j*stride + stride/2;
+        removals[j].count = 1;
+    }
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v(input);
+        v.editArrayImpl();
+        run.resume();
+        v.editBatch(insertions, kScatteredEdits, removals, kScatteredEdits);
+        run.pause();
+    }
+}
+
+template <typename TYPE>
+static bool isOdd(const void* item, void*)
+{
+    return reinterpret_cast<const TYPE*>(item)->key & 1;
+}
+
+// filters out every other item with removeItemsAt(), one tail move each
+template <typename TYPE, uint32_t FLAGS>
+void benchRemoveEach(BenchmarkRun& run)
+{
+    BenchmarkVector<TYPE, FLAGS> input;
+    for (size_t j = 0 ; j < run.count() ; j++) {
+        const TYPE item = makeBenchmarkItem<TYPE>(int32_t(j));
+        input.push(&item);
+    }
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v(input);
+        v.editArrayImpl();
+        run.resume();
+        for (size_t j = 0 ; j < v.size() ; ) {
+            if (isOdd<TYPE>(v.itemLocation(j), 0)) {
+                v.removeItemsAt(j);
+            } else {
+                j++;
+            }
+        }
+        run.pause();
+    }
+}
+
+// ...and with a single removeItemsIf()
+template <typename TYPE, uint32_t FLAGS>
+void benchRemoveIf(BenchmarkRun& run)
+{
+    BenchmarkVector<TYPE, FLAGS> input;
+    for (size_t j = 0 ; j < run.count() ; j++) {
+        const TYPE item = makeBenchmarkItem<TYPE>(int32_t(j));
+        input.push(&item);
+    }
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v(input);
+        v.editArrayImpl();
+        run.resume();
+        v.removeItemsIf(isOdd<TYPE>, 0);
+        run.pause();
+    }
+}
+
+static uint64_t reallocations()
+{
+    VectorPolicy::Stats stats;
+    VectorPolicy::getStats(&stats);
+    return stats.events[VectorPolicy::GROW] + stats.events[VectorPolicy::GROW_IN_PLACE] +
+            stats.events[VectorPolicy::SHRINK] + stats.events[VectorPolicy::SHRINK_IN_PLACE];
+}
+
+// a queue that keeps draining to half its size and filling up again, the
+// pattern the shrink hysteresis is meant for
+template <typename TYPE, uint32_t FLAGS>
+void benchPushPop(BenchmarkRun& run)
+{
+    const size_t kRounds = 8;
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    uint64_t reallocs = 0;
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v;
+        v.insertAt(&item, 0, run.count());
+        const uint64_t before = reallocations();
+        run.resume();
+        for (size_t r = 0 ; r < kRounds ; r++) {
+            while (v.size() > run.count() / 2) {
+                v.pop();
+            }
+            while (v.size() < run.count()) {
+                v.push(&item);
+            }
+        }
+        run.pause();
+        reallocs += reallocations() - before;
+    }
+    run.setCounter("reallocs", double(reallocs) / run.iterations());
+}
+
+// copy-on-write: the first edit of a shared vector copies its storage
+template <typename TYPE, uint32_t FLAGS>
+void benchEditShared(BenchmarkRun& run)
+{
+    BenchmarkVector<TYPE, FLAGS> input;
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    input.insertAt(&item, 0, run.count());
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v(input);
+        run.resume();
+        v.editArrayImpl();
+        run.pause();
+    }
+}
+
+// dropping the last reference to a large vector, as seen by the thread
+// doing it; with VECTORIMPL_RECLAIM the freeing happens elsewhere for the
+// items with a trivial destructor
+template <typename TYPE, uint32_t FLAGS>
+void benchReleaseLarge(BenchmarkRun& run)
+{
+    const TYPE item = makeBenchmarkItem<TYPE>(1);
+    for (size_t i = 0 ; i < run.iterations() ; i++) {
+        BenchmarkVector<TYPE, FLAGS> v;
+        v.insertAt(&item, 0, run.count());
+        run.resume();
+        v.clear();
+        run.pause();
+        VectorReclaimer::drain();
+    }
+}
+
+const size_t kAppendCounts[] = { 16, 256, 4096 };
+const size_t kReleaseCounts[] = { 1024, 4096, 16384 };
+const size_t kShiftCounts[] = { 16, 256, 2048 };
+
+BENCHMARK_ALL_ITEMS(push, benchPush, kAppendCounts);
+BENCHMARK_ALL_ITEMS(insert_front, benchInsertFront, kShiftCounts);
+BENCHMARK_ALL_ITEMS(insert_middle, benchInsertMiddle, kShiftCounts);
+BENCHMARK_ALL_ITEMS(remove_front, benchRemoveFront, kShiftCounts);
+BENCHMARK_ALL_ITEMS(remove_each, benchRemoveEach, kShiftCounts);
+BENCHMARK_ALL_ITEMS(remove_if, benchRemoveIf, kShiftCounts);
+BENCHMARK_ALL_ITEMS(scattered_each, benchScatteredEach, kShiftCounts);
+BENCHMARK_ALL_ITEMS(scattered_batch, benchScatteredBatch, kShiftCounts);
+BENCHMARK_ALL_ITEMS(pop, benchPop, kAppendCounts);
+BENCHMARK_ALL_ITEMS(push_pop, benchPushPop, kAppendCounts);
+BENCHMARK_ALL_ITEMS(edit_shared, benchEditShared, kAppendCounts);
+BENCHMARK_ALL_ITEMS(replace_each, benchReplaceEach, kAppendCounts);
+BENCHMARK_ALL_ITEMS(edit_range, benchEditRange, kAppendCounts);
+BENCHMARK_ALL_ITEMS(replace_array, benchReplaceArray, kAppendCounts);
+BENCHMARK_ALL_ITEMS(copy_hand_over, benchCopyHandOver, kAppendCounts);
+BENCHMARK_ALL_ITEMS(move_hand_over, benchMoveHandOver, kAppendCounts);
+BENCHMARK_ITEM_FLAGS(release_large, benchReleaseLarge, kReleaseCounts, 64);
+
+// relocatable items, against the "none" runs above
+BENCHMARK_MOVABLE_ITEMS(push, benchPush, kAppendCounts);
+BENCHMARK_MOVABLE_ITEMS(insert_middle, benchInsertMiddle, kShiftCounts);
+BENCHMARK_MOVABLE_ITEMS(remove_front, benchRemoveFront, kShiftCounts);
+BENCHMARK_MOVABLE_ITEMS(push_pop, benchPushPop, kAppendCounts);
+
+// the item sizes with their own copy, move and splat kernels
+BENCHMARK_ALL_ITEMS(insert_near_end, benchInsertNearEnd, kAppendCounts);
+BENCHMARK_ITEM_FLAGS(insert_near_end, benchInsertNearEnd, kAppendCounts, 8);
+BENCHMARK_ITEM_FLAGS(insert_near_end, benchInsertNearEnd, kAppendCounts, 32);
+BENCHMARK_ALL_ITEMS(splat, benchSplat, kAppendCounts);
+BENCHMARK_ITEM_FLAGS(splat, benchSplat, kAppendCounts, 8);
+BENCHMARK_ITEM_FLAGS(splat, benchSplat, kAppendCounts, 32);
+
+} // namespace
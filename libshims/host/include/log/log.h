@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for liblog, covering the macros the shim uses. Messages
+ * go to stderr; fatal ones abort(). ALOGV and ALOG_ASSERT compile away
+ * unless LOG_NDEBUG is 0, as on the device.
+ */
+
+#ifndef _LIBS_LOG_LOG_H
+#define _LIBS_LOG_LOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef LOG_TAG
+#define LOG_TAG NULL
+#endif
+
+#ifndef LOG_NDEBUG
+#ifdef NDEBUG
+#define LOG_NDEBUG 1
+#else
+#define LOG_NDEBUG 0
+#endif
+#endif
+
+#define __host_log(prio, ...) \
+    ((void)fprintf(stderr, "%c/%s: ", prio, LOG_TAG ? LOG_TAG : ""), \
+     (void)fprintf(stderr, " " __VA_ARGS__), \
+     (void)fputc('\n', stderr))
+
+#if LOG_NDEBUG
+#define ALOGV(...)   ((void)0)
+#else
+#define ALOGV(...)   __host_log('V', __VA_ARGS__)
+#endif
+#define ALOGD(...)   __host_log('D', __VA_ARGS__)
+#define ALOGI(...)   __host_log('I', __VA_ARGS__)
+#define ALOGW(...)   __host_log('W', __VA_ARGS__)
+#define ALOGE(...)   __host_log('E', __VA_ARGS__)
+
+#define ALOGW_IF(cond, ...) \
+    ((cond) ? __host_log('W', __VA_ARGS__) : (void)0)
+#define ALOGE_IF(cond, ...) \
+    ((cond) ? __host_log('E', __VA_ARGS__) : (void)0)
+
+#define LOG_ALWAYS_FATAL(...) \
+    (__host_log('F', __VA_ARGS__), abort())
+#define LOG_ALWAYS_FATAL_IF(cond, ...) \
+    ((cond) ? LOG_ALWAYS_FATAL(__VA_ARGS__) : (void)0)
+
+#if LOG_NDEBUG
+#define ALOG_ASSERT(cond, ...)  ((void)0)
+#else
+#define ALOG_ASSERT(cond, ...)  LOG_ALWAYS_FATAL_IF(!(cond), ## __VA_ARGS__)
+#endif
+
+#endif // _LIBS_LOG_LOG_H
@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2017 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for external/safe-iop. Only the three operations the
+ * shim uses are provided, on top of the compiler's overflow builtins.
+ * Like the real macros, they return true when the result fits.
+ */
+
+#ifndef _SAFE_IOP_H
+#define _SAFE_IOP_H
+
+#define safe_add(_ptr, __a, __b) (!__builtin_add_overflow((__a), (__b), (_ptr)))
+#define safe_sub(_ptr, __a, __b) (!__builtin_sub_overflow((__a), (__b), (_ptr)))
+#define safe_mul(_ptr, __a, __b) (!__builtin_mul_overflow((__a), (__b), (_ptr)))
+
+#endif // _SAFE_IOP_H